@@ -49,7 +49,6 @@ double core_mhz(int verbose) {
     }
     while (fgets(buf, MAXBUF, fp)) {
 	if (strstr(buf, "cpu MHz")) {
-	    double cpu_mhz = 0.0;
 	    sscanf(buf, "cpu MHz\t: %lf", &cpu_mhz);
 	    break;
 	}
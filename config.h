@@ -43,7 +43,12 @@
   "syn-array.rep", \
   "syn-mix.rep", \
   "syn-string.rep", \
-  "syn-struct.rep"
+  "syn-struct.rep", \
+  "syn-batch.rep", \
+  "syn-batch-single.rep", \
+  "syn-mix-sized.rep", \
+  "syn-aligned.rep", \
+  "syn-calloc.rep"
 
 /*
  * Programs for measuring reference throughputs
@@ -103,6 +108,39 @@
  */
 #define MAX_HEAP_SIZE (1ull*(1ull<<40)) /* 1 TB */
 
+/*
+ * Number of independent arenas the heap is split into.  Each arena
+ * gets MAX_HEAP_SIZE / MAX_ARENAS bytes of address space and its own
+ * break pointer.  Arena 0 is the one mem_sbrk extends.  The allocator
+ * grows its heap through the first 64 GB of an arena at most.
+ */
+#define MAX_ARENAS 4
+
+/*
+ * Address space reserved for regions mapped with mem_map, outside the
+ * arenas, and the most regions that may be mapped at once.
+ */
+#define MAX_MAP_SIZE (1ull*(1ull<<40)) /* 1 TB */
+#define MAX_REGIONS 4096
+
+/*
+ * mem_memcpy and mem_memset calls of at least this many bytes use
+ * non-temporal stores, which bypass the cache they would only flush.
+ */
+#define STREAM_MIN (1ull << 20) /* 1 MB */
+
+/*********** Parameters controlling sparse memory version of heap ***********/
+/*
+ * Built with -DSPARSE_HEAP (make sparse), the arenas and the mapped
+ * regions only reserve address space.  Their contents live in a hash
+ * table of SPARSE_PAGE-byte pages, each made when a nonzero byte is
+ * first written to it, so resident memory follows the data touched
+ * rather than the size of the heap.
+ */
+#define SPARSE_PAGE 4096
+#define SPARSE_HEAP_SIZE (1ull*(1ull<<45)) /* 32 TB */
+#define SPARSE_MAP_SIZE (1ull*(1ull<<45)) /* 32 TB */
+
 
 /***************** Parameters for looking up reference throughput *********/
 /*
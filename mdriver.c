@@ -20,10 +20,18 @@
 #include <unistd.h>
 #include <stdbool.h>
 #include <math.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#ifdef THREAD_SAFE
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
 #include "fcyc.h"
+#include "clock.h"
 #include "config.h"
 #include "stree.h"
 
@@ -40,8 +48,8 @@
 #define REF_ONLY 0
 #endif
 
-/* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
+/* Returns true if p is a-byte aligned */
+#define IS_ALIGNED(p, a)  ((((unsigned long)(p)) % (a)) == 0)
 
 /* weights */
 typedef enum { WNONE, WALL, WUTIL, WPERF } weight_t;
@@ -80,9 +88,13 @@ typedef struct {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
+    enum { ALLOC, FREE, REALLOC, ALLOC_BATCH, FREE_BATCH, FREE_SIZED,
+           ALLOC_ALIGNED, CALLOC } type; /* type of request */
     long index;                         /* index for free() to use later */
-    size_t size;                        /* byte size of alloc/realloc request */
+    size_t size;                        /* byte size of alloc/realloc request,
+                                           or of the block a sized free frees */
+    int count;                          /* ids index .. index+count-1 of a batch */
+    size_t alignment;                   /* payload alignment of an aligned alloc */
 } traceop_t;
 
 /* Holds the information for one trace file */
@@ -91,6 +103,7 @@ typedef struct {
     size_t data_bytes;    /* Peak number of data bytes allocated during trace */
     int num_ids;          /* number of alloc/realloc ids */
     int num_ops;          /* number of distinct requests */
+    int num_requests;     /* allocator requests, counting each block of a batch */
     weight_t weight;      /* weight for this trace */
     traceop_t *ops;       /* array of requests */
     char **blocks;        /* array of ptrs returned by malloc/realloc... */
@@ -121,6 +134,17 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;       /* space utilization for this trace (always 0 for libc) */
+    double max_cycles[3]; /* worst-case cycles of one op, indexed by op type (-w) */
+    double peak_heap;  /* largest heap size in bytes, mapped regions included */
+    double final_heap; /* heap size in bytes after the last op */
+    double avg_heap;   /* heap size in bytes averaged over all ops */
+    double extends;    /* extend_heap calls in one run of the trace */
+    double dtlb_misses; /* dTLB misses in one run of the trace, -1 if unknown (-b) */
+    double copy_bytes; /* bytes moved by mem_memcpy/mem_memmove in one run */
+    double set_bytes;  /* bytes filled by mem_memset in one run */
+    double copy_secs;  /* seconds spent in those copies (-k) */
+    double resident;   /* resident heap pages after the last op (-r) */
+    double resident_peak; /* most resident heap pages, -1 if unknown (-r) */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -160,6 +184,15 @@ int verbose = REF_ONLY ? 0 : 1;  /* global flag for verbose output */
 static int errors = 0;           /* number of errs found when running student malloc */
 static bool onetime_flag = false;
 static bool tab_mode = false;     /* Print output as tab-separated fields */
+static bool latency_flag = false; /* Report worst-case cycles of a single op */
+static bool footprint_flag = false; /* Report final and average heap size */
+static bool dtlb_flag = false;    /* Report dTLB misses of a run of each trace */
+static bool copy_flag = false;    /* Report bytes copied and set per trace */
+static bool resident_flag = false; /* Report resident heap pages per trace */
+#ifdef THREAD_SAFE
+static int scale_threads = 0;     /* Max threads for the scaling benchmark */
+static int xfer_pairs = 0;        /* Producer/consumer pairs for the cross-thread benchmark */
+#endif
 static size_t maxfill = MAXFILL;
 
 /* by default, no timeouts */
@@ -195,7 +228,7 @@ static void add_tracefile(char *trace);
 /* these functions manipulate range sets */
 static range_set_t *new_range_set();
 static bool add_range(range_set_t *ranges, char *lo, size_t size,
-                      const trace_t *trace, int opnum, int index);
+                      size_t alignment, const trace_t *trace, int opnum, int index);
 static void remove_range(range_set_t *ranges, char *lo);
 static void free_range_set(range_set_t *ranges);
 
@@ -217,11 +250,22 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static bool eval_mm_valid(trace_t *trace, range_set_t *ranges);
-static double eval_mm_util(trace_t *trace, int tracenum);
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static void eval_mm_dtlb(speed_t *speed_params, stats_t *stats);
+#ifdef THREAD_SAFE
+static void eval_mm_scaling(int max_threads);
+static void eval_mm_xfer(int npairs);
+#endif
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void printlatency(int n, stats_t *stats);
+static void printfootprint(int n, stats_t *stats);
+static void printdtlb(int n, stats_t *stats);
+static void printcopy(int n, stats_t *stats);
+static void printresident(int n, stats_t *stats);
 static void usage(char *prog);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -263,7 +307,7 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         trace_t *trace;
         trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
         strcpy(mm_stats[i].filename, trace->filename);
-        mm_stats[i].ops = trace->num_ops;
+        mm_stats[i].ops = trace->num_requests;
 
         /* Prepare for timeout */
         if (setjmp(timeout_jmpbuf) != 0) {
@@ -283,12 +327,16 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         if (mm_stats[i].valid) {
             if (verbose > 1)
                 printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i);
+            mm_stats[i].util = eval_mm_util(trace, i, &mm_stats[i]);
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
             mm_stats[i].secs = fsec(eval_mm_speed, speed_params);
+            if (latency_flag)
+                eval_mm_latency(trace, &mm_stats[i]);
+            if (dtlb_flag)
+                eval_mm_dtlb(speed_params, &mm_stats[i]);
         }
 
 #if 0
@@ -356,7 +404,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hOVlDT")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hOVlDTwmbkrHp:x:")) != EOF) {
         switch (c) {
 
             case 'f': /* Use one specific trace file only (relative to curr dir) */
@@ -406,6 +454,46 @@ int main(int argc, char **argv)
                 tab_mode = true;
                 break;
 
+            case 'w': /* Report worst-case cycles of a single op */
+                latency_flag = true;
+                break;
+
+            case 'm': /* Report final and time-averaged heap size */
+                footprint_flag = true;
+                break;
+
+            case 'b': /* Report dTLB misses */
+                dtlb_flag = true;
+                break;
+
+            case 'k': /* Report bytes copied and set */
+                copy_flag = true;
+                break;
+
+            case 'r': /* Report resident heap pages */
+                resident_flag = true;
+                break;
+
+            case 'H': /* Back the heap with transparent huge pages */
+                mem_set_hugepages(true);
+                break;
+
+            case 'p': /* Measure malloc/free scaling with up to n threads */
+#ifdef THREAD_SAFE
+                scale_threads = atoi(optarg);
+#else
+                app_error("-p requires a thread-safe build (make threads)\n");
+#endif
+                break;
+
+            case 'x': /* Measure frees of blocks malloc'd by another thread */
+#ifdef THREAD_SAFE
+                xfer_pairs = atoi(optarg);
+#else
+                app_error("-x requires a thread-safe build (make threads)\n");
+#endif
+                break;
+
             case 'h': /* Print this message */
                 usage(argv[0]);
                 exit(0);
@@ -514,9 +602,55 @@ int main(int argc, char **argv)
             printf("\nResults for mm malloc:\n");
             printresults(num_global_tracefiles, mm_stats, &global_mm_sum_stats);
             printf("\n");
+            if (latency_flag) {
+                printf("Worst-case cycles of a single op:\n");
+                printlatency(num_global_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (footprint_flag) {
+                printf("Heap size in KB (peak, after the last op, averaged over ops)\n"
+                       "and extend_heap calls per trace:\n");
+                printfootprint(num_global_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (dtlb_flag) {
+                printf("dTLB misses in one run of each trace (huge pages %s):\n",
+                       mem_hugepages() ? "on" : "off");
+                printdtlb(num_global_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (copy_flag) {
+                printf("KB copied and set by the allocator in one run of each trace\n"
+                       "and the copy rate over the time spent copying:\n");
+                printcopy(num_global_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (resident_flag) {
+                printf("Resident heap pages (peak, after the last op) and the peak\n"
+                       "heap size in pages, %s heap:\n",
+#ifdef SPARSE_HEAP
+                       "sparse"
+#else
+                       "dense"
+#endif
+                       );
+                printresident(num_global_tracefiles, mm_stats);
+                printf("\n");
+            }
         }
     }
 
+#ifdef THREAD_SAFE
+    /* Optionally measure how malloc/free pairs scale with threads */
+    if (scale_threads > 0) {
+        eval_mm_scaling(scale_threads);
+    }
+    /* Optionally compare cross-thread frees with and without remote queues */
+    if (xfer_pairs > 0) {
+        eval_mm_xfer(xfer_pairs);
+    }
+#endif
+
     /* Optionally compare the performance of mm and libc */
     if (run_libc) {
         printf("Comparison with libc malloc: mm/libc = %.0f Kops / %.0f Kops = %.2f\n", 
@@ -675,27 +809,30 @@ static range_set_t *new_range_set() {
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of
- *     size bytes at addr lo. After checking the block for correctness,
+ *     size bytes at addr lo, aligned to alignment bytes. After checking
+ *     the block for correctness,
  *     we create a range struct for this block and add it to the range list.
  */
 static bool add_range(range_set_t *ranges, char *lo, size_t size,
-                      const trace_t *trace, int opnum, int index) {
+                      size_t alignment, const trace_t *trace, int opnum, int index) {
     char *hi = lo + size - 1;
 
     assert(size > 0);
 
-    /* Payload addresses must be ALIGNMENT-byte aligned */
-    if (!IS_ALIGNED(lo)) {
+    /* Payload addresses must be aligned as requested */
+    if (!IS_ALIGNED(lo, alignment)) {
         malloc_error(trace, opnum,
-                     "Payload address (%p) not aligned to %d bytes", lo, ALIGNMENT);
+                     "Payload address (%p) not aligned to %lu bytes", lo, alignment);
         return false;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or within
+       a single region mapped with mem_map */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        !mem_is_mapped(lo, hi)) {
         malloc_error(trace, opnum,
-                     "Payload (%p:%p) lies outside heap (%p:%p)",
+                     "Payload (%p:%p) lies outside heap (%p:%p) and mapped regions",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
         return false;
     }
@@ -902,7 +1039,8 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     trace_t *trace;
     char type[MAXLINE];
     int index;
-    size_t size;
+    int count;
+    size_t size, alignment;
     int max_index = 0;
     int op_index;
     int ignore = 0;
@@ -955,6 +1093,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
+    trace->num_requests = trace->num_ops;
     while (fscanf(tracefile, "%s", type) != EOF) {
         switch(type[0]) {
             case 'a':
@@ -962,6 +1101,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
                 trace->ops[op_index].type = ALLOC;
                 trace->ops[op_index].index = index;
                 trace->ops[op_index].size = size;
+                trace->block_sizes[index] = size;
                 max_index = (index > max_index) ? index : max_index;
                 break;
             case 'r':
@@ -969,6 +1109,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
                 trace->ops[op_index].type = REALLOC;
                 trace->ops[op_index].index = index;
                 trace->ops[op_index].size = size;
+                trace->block_sizes[index] = size;
                 max_index = (index > max_index) ? index : max_index;
                 break;
             case 'f':
@@ -976,6 +1117,47 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
                 trace->ops[op_index].type = FREE;
                 trace->ops[op_index].index = index;
                 break;
+            case 'm':
+                ignore += fscanf(tracefile, "%u %lu %lu", &index, &alignment, &size);
+                trace->ops[op_index].type = ALLOC_ALIGNED;
+                trace->ops[op_index].index = index;
+                trace->ops[op_index].alignment = alignment;
+                trace->ops[op_index].size = size;
+                trace->block_sizes[index] = size;
+                max_index = (index > max_index) ? index : max_index;
+                break;
+            case 'c':
+                ignore += fscanf(tracefile, "%u %lu", &index, &size);
+                trace->ops[op_index].type = CALLOC;
+                trace->ops[op_index].index = index;
+                trace->ops[op_index].size = size;
+                trace->block_sizes[index] = size;
+                max_index = (index > max_index) ? index : max_index;
+                break;
+            case 's':
+                ignore += fscanf(tracefile, "%u", &index);
+                trace->ops[op_index].type = FREE_SIZED;
+                trace->ops[op_index].index = index;
+                trace->ops[op_index].size = trace->block_sizes[index];  /* replayed so far */
+                break;
+            case 'A':
+                ignore += fscanf(tracefile, "%u %u %lu", &index, &count, &size);
+                trace->ops[op_index].type = ALLOC_BATCH;
+                trace->ops[op_index].index = index;
+                trace->ops[op_index].count = count;
+                trace->ops[op_index].size = size;
+                for (int j = index; j < index + count; j++)
+                    trace->block_sizes[j] = size;
+                max_index = (index + count - 1 > max_index) ? index + count - 1 : max_index;
+                trace->num_requests += count - 1;
+                break;
+            case 'F':
+                ignore += fscanf(tracefile, "%u %u", &index, &count);
+                trace->ops[op_index].type = FREE_BATCH;
+                trace->ops[op_index].index = index;
+                trace->ops[op_index].count = count;
+                trace->num_requests += count - 1;
+                break;
             default:
                 app_error("Bogus type character (%c) in tracefile %s\n",
                           type[0], trace->filename);
@@ -986,11 +1168,12 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
+    reinit_trace(trace);      /* block_sizes was scratch for the sized frees */
 
     /* fill in the stats */
     strcpy(stats->filename, trace->filename);
     stats->weight = trace->weight;
-    stats->ops = trace->num_ops;
+    stats->ops = trace->num_requests;
 
     return trace;
 }
@@ -1028,9 +1211,9 @@ static void free_trace(trace_t *trace)
  */
 static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
 {
-    int i;
-    int index;
-    size_t size;
+    int i, j;
+    int index, count;
+    size_t size, k;
     char *newp;
     char *oldp;
     char *p;
@@ -1083,9 +1266,14 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
                  * to the range list if OK. The block must be  be aligned properly,
                  * and must not overlap any currently allocated block.
                  */
-                if (add_range(ranges, p, size, trace, i, index) == 0)
+                if (add_range(ranges, p, size, ALIGNMENT, trace, i, index) == 0)
                     return false;
 
+                if (mm_usable_size(p) < size) {
+                    malloc_error(trace, i, "mm_usable_size below the request.");
+                    return false;
+                }
+
                 /* Remember region */
                 trace->blocks[index] = p;
                 trace->block_sizes[index] = size;
@@ -1094,6 +1282,37 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
                 randomize_block(trace, index);
                 break;
 
+            case CALLOC: /* mm_calloc */
+                if ((p = mm_calloc(1, size)) == NULL) {
+                    malloc_error(trace, i, "mm_calloc failed.");
+                    return false;
+                }
+                if (add_range(ranges, p, size, ALIGNMENT, trace, i, index) == 0)
+                    return false;
+                for (k = 0; k < size; k++) {
+                    if (mem_read(&p[k], 1) != 0) {
+                        malloc_error(trace, i, "mm_calloc block not zero at byte %zu.", k);
+                        return false;
+                    }
+                }
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
+                randomize_block(trace, index);
+                break;
+
+            case ALLOC_ALIGNED: /* mm_memalign */
+                if ((p = mm_memalign(trace->ops[i].alignment, size)) == NULL) {
+                    malloc_error(trace, i, "mm_memalign failed.");
+                    return false;
+                }
+                if (add_range(ranges, p, size, trace->ops[i].alignment,
+                              trace, i, index) == 0)
+                    return false;
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
+                randomize_block(trace, index);
+                break;
+
             case REALLOC: /* mm_realloc */
                 if (!check_index(trace, i, index, 0))
                     return false;
@@ -1116,7 +1335,7 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
 
                 /* Check new block for correctness and add it to range list */
                 if (size > 0) {
-                    if (add_range(ranges, newp, size, trace, i, index) == 0)
+                    if (add_range(ranges, newp, size, ALIGNMENT, trace, i, index) == 0)
                         return false;
                 }
 
@@ -1151,6 +1370,39 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
                 mm_free(p);
                 break;
 
+            case FREE_SIZED: /* mm_free_sized */
+                if (!check_index(trace, i, index, 0))
+                    return false;
+                p = trace->blocks[index];
+                remove_range(ranges, p);
+                mm_free_sized(p, size);
+                break;
+
+            case ALLOC_BATCH: /* mm_malloc_batch */
+                count = trace->ops[i].count;
+                if (mm_malloc_batch(size, count, (void **)&trace->blocks[index])
+                    != (size_t)count) {
+                    malloc_error(trace, i, "mm_malloc_batch failed.");
+                    return false;
+                }
+                for (j = index; j < index + count; j++) {
+                    if (add_range(ranges, trace->blocks[j], size, ALIGNMENT, trace, i, j) == 0)
+                        return false;
+                    trace->block_sizes[j] = size;
+                    randomize_block(trace, j);
+                }
+                break;
+
+            case FREE_BATCH: /* mm_free_batch */
+                count = trace->ops[i].count;
+                for (j = index; j < index + count; j++) {
+                    if (!check_index(trace, i, j, 0))
+                        return false;
+                    remove_range(ranges, trace->blocks[j]);
+                }
+                mm_free_batch((void **)&trace->blocks[index], count);
+                break;
+
             default:
                 app_error("Nonexistent request type in eval_mm_valid");
         }
@@ -1164,22 +1416,28 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   largest size of the heap in bytes while running the student's
+ *   malloc package on the trace. mem_sbrk() may decrement the brk
+ *   pointer, so the final and op-averaged heap sizes are recorded in
+ *   stats as well. Regions mapped with mem_map are added to the heap
+ *   size while they are mapped, so the high water mark covers the
+ *   largest combined footprint.
  *
  *   A higher number is better: 1 is optimal.
  */
-static double eval_mm_util(trace_t *trace, int tracenum)
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats)
 {
-    int i;
-    int index;
+    int i, j;
+    int index, count;
     size_t size, newsize, oldsize;
     size_t max_total_size = 0;
     size_t total_size = 0;
     size_t max_heap_size = 0;
     size_t heap_size = 0;
+    double sum_heap_size = 0;
+    size_t copied, set;
+    double copy_secs;
+    mm_stats_t mm_counters;
     char *p;
     char *newp, *oldp;
 
@@ -1189,6 +1447,10 @@ static double eval_mm_util(trace_t *trace, int tracenum)
     mem_reset_brk();
     if (!mm_init())
         app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
+    copied = mem_copied_bytes();
+    set = mem_set_bytes();
+    copy_secs = mem_copy_secs();
+    mem_set_copy_timing(copy_flag);
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
@@ -1209,6 +1471,34 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 total_size += size;
                 break;
 
+            case CALLOC: /* mm_calloc */
+                index = trace->ops[i].index;
+                size = trace->ops[i].size;
+
+                if ((p = mm_calloc(1, size)) == NULL) {
+                    app_error("trace %d: mm_calloc failed in eval_mm_util",
+                              tracenum);
+                }
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
+
+                total_size += size;
+                break;
+
+            case ALLOC_ALIGNED: /* mm_memalign */
+                index = trace->ops[i].index;
+                size = trace->ops[i].size;
+
+                if ((p = mm_memalign(trace->ops[i].alignment, size)) == NULL) {
+                    app_error("trace %d: mm_memalign failed in eval_mm_util",
+                              tracenum);
+                }
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
+
+                total_size += size;
+                break;
+
             case REALLOC: /* mm_realloc */
                 index = trace->ops[i].index;
                 newsize = trace->ops[i].size;
@@ -1242,6 +1532,39 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 total_size -= size;
                 break;
 
+            case FREE_SIZED: /* mm_free_sized */
+                index = trace->ops[i].index;
+                size = trace->ops[i].size;
+                mm_free_sized(trace->blocks[index], size);
+
+                total_size -= size;
+                break;
+
+            case ALLOC_BATCH: /* mm_malloc_batch */
+                index = trace->ops[i].index;
+                count = trace->ops[i].count;
+                size = trace->ops[i].size;
+
+                if (mm_malloc_batch(size, count, (void **)&trace->blocks[index])
+                    != (size_t)count) {
+                    app_error("trace %d: mm_malloc_batch failed in eval_mm_util",
+                              tracenum);
+                }
+                for (j = index; j < index + count; j++)
+                    trace->block_sizes[j] = size;
+
+                total_size += size * count;
+                break;
+
+            case FREE_BATCH: /* mm_free_batch */
+                index = trace->ops[i].index;
+                count = trace->ops[i].count;
+                for (j = index; j < index + count; j++)
+                    total_size -= trace->block_sizes[j];
+
+                mm_free_batch((void **)&trace->blocks[index], count);
+                break;
+
             default:
                 app_error("trace %d: Nonexistent request type in eval_mm_util",
                           tracenum);
@@ -1250,9 +1573,28 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         /* update the high-water mark */
         max_total_size = (total_size > max_total_size) ?
             total_size : max_total_size;
-        heap_size = mem_heapsize();
+        heap_size = mem_heapsize() + mem_mapsize();    /* mapped regions count too */
         max_heap_size = (heap_size > max_heap_size) ?
             heap_size : max_heap_size;
+        sum_heap_size += heap_size;
+    }
+
+    stats->peak_heap = max_heap_size;
+    stats->final_heap = heap_size;
+    stats->avg_heap = trace->num_ops ? sum_heap_size / trace->num_ops : 0;
+    mm_get_stats(&mm_counters);
+    stats->extends = mm_counters.extend_calls;
+    stats->copy_bytes = mem_copied_bytes() - copied;
+    stats->set_bytes = mem_set_bytes() - set;
+    stats->copy_secs = mem_copy_secs() - copy_secs;
+    mem_set_copy_timing(false);
+    if (resident_flag) {
+        stats->resident = mem_resident_pages();
+#ifdef SPARSE_HEAP
+        stats->resident_peak = mem_resident_peak();
+#else
+        stats->resident_peak = -1;      /* the kernel keeps no peak per mapping */
+#endif
     }
 
 #if !REF_ONLY
@@ -1269,7 +1611,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index;
+    int i, index, count;
     size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
@@ -1292,6 +1634,21 @@ static void eval_mm_speed(void *ptr)
                 trace->blocks[index] = p;
                 break;
 
+            case CALLOC: /* mm_calloc */
+                index = trace->ops[i].index;
+                if ((p = mm_calloc(1, trace->ops[i].size)) == NULL)
+                    app_error("mm_calloc error in eval_mm_speed");
+                trace->blocks[index] = p;
+                break;
+
+            case ALLOC_ALIGNED: /* mm_memalign */
+                index = trace->ops[i].index;
+                if ((p = mm_memalign(trace->ops[i].alignment,
+                                     trace->ops[i].size)) == NULL)
+                    app_error("mm_memalign error in eval_mm_speed");
+                trace->blocks[index] = p;
+                break;
+
             case REALLOC: /* mm_realloc */
                 index = trace->ops[i].index;
                 newsize = trace->ops[i].size;
@@ -1311,11 +1668,381 @@ static void eval_mm_speed(void *ptr)
                 mm_free(block);
                 break;
 
+            case FREE_SIZED: /* mm_free_sized */
+                index = trace->ops[i].index;
+                mm_free_sized(trace->blocks[index], trace->ops[i].size);
+                break;
+
+            case ALLOC_BATCH: /* mm_malloc_batch */
+                index = trace->ops[i].index;
+                count = trace->ops[i].count;
+                if (mm_malloc_batch(trace->ops[i].size, count,
+                                    (void **)&trace->blocks[index]) != (size_t)count)
+                    app_error("mm_malloc_batch error in eval_mm_speed");
+                break;
+
+            case FREE_BATCH: /* mm_free_batch */
+                index = trace->ops[i].index;
+                mm_free_batch((void **)&trace->blocks[index], trace->ops[i].count);
+                break;
+
             default:
                 app_error("Nonexistent request type in eval_mm_speed");
         }
 }
 
+/*
+ * eval_mm_latency - Find the worst-case cost of a single operation.
+ *    Every op is timed on its own with the cycle counter. The trace is
+ *    replayed LATENCY_RUNS times and each op keeps its fastest time, so
+ *    that interrupts and first-touch page faults are not charged to the
+ *    allocator. The slowest op of each type is then recorded in stats,
+ *    batch and sized ops with the plain ones of their kind.
+ */
+#define LATENCY_RUNS 3
+
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    int i, run, index;
+    size_t size;
+    char *p, *newp, *oldp;
+    double cycles;
+    double *best;
+    size_t done;
+
+    if ((best = (double *)malloc(trace->num_ops * sizeof(double))) == NULL)
+        unix_error("malloc failed in eval_mm_latency");
+    for (i = 0;  i < trace->num_ops;  i++)
+        best[i] = DBL_MAX;
+
+    for (run = 0;  run < LATENCY_RUNS;  run++) {
+        reinit_trace(trace);
+        mem_reset_brk();
+        if (!mm_init())
+            app_error("mm_init failed in eval_mm_latency");
+
+        for (i = 0;  i < trace->num_ops;  i++) {
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            switch (trace->ops[i].type) {
+
+                case ALLOC: /* mm_malloc */
+                    start_counter();
+                    p = mm_malloc(size);
+                    cycles = get_counter();
+                    if (p == NULL)
+                        app_error("mm_malloc error in eval_mm_latency");
+                    trace->blocks[index] = p;
+                    break;
+
+                case CALLOC: /* mm_calloc */
+                    start_counter();
+                    p = mm_calloc(1, size);
+                    cycles = get_counter();
+                    if (p == NULL)
+                        app_error("mm_calloc error in eval_mm_latency");
+                    trace->blocks[index] = p;
+                    break;
+
+                case ALLOC_ALIGNED: /* mm_memalign */
+                    start_counter();
+                    p = mm_memalign(trace->ops[i].alignment, size);
+                    cycles = get_counter();
+                    if (p == NULL)
+                        app_error("mm_memalign error in eval_mm_latency");
+                    trace->blocks[index] = p;
+                    break;
+
+                case REALLOC: /* mm_realloc */
+                    oldp = trace->blocks[index];
+                    start_counter();
+                    newp = mm_realloc(oldp, size);
+                    cycles = get_counter();
+                    if (newp == NULL && size != 0)
+                        app_error("mm_realloc error in eval_mm_latency");
+                    trace->blocks[index] = newp;
+                    break;
+
+                case FREE: /* mm_free */
+                    p = (index < 0) ? 0 : trace->blocks[index];
+                    start_counter();
+                    mm_free(p);
+                    cycles = get_counter();
+                    break;
+
+                case FREE_SIZED: /* mm_free_sized */
+                    p = trace->blocks[index];
+                    start_counter();
+                    mm_free_sized(p, size);
+                    cycles = get_counter();
+                    break;
+
+                case ALLOC_BATCH: /* mm_malloc_batch */
+                    start_counter();
+                    done = mm_malloc_batch(size, trace->ops[i].count,
+                                           (void **)&trace->blocks[index]);
+                    cycles = get_counter();
+                    if (done != (size_t)trace->ops[i].count)
+                        app_error("mm_malloc_batch error in eval_mm_latency");
+                    break;
+
+                case FREE_BATCH: /* mm_free_batch */
+                    start_counter();
+                    mm_free_batch((void **)&trace->blocks[index], trace->ops[i].count);
+                    cycles = get_counter();
+                    break;
+
+                default:
+                    app_error("Nonexistent request type in eval_mm_latency");
+            }
+            if (cycles < best[i])
+                best[i] = cycles;
+        }
+    }
+
+    stats->max_cycles[ALLOC] = 0;
+    stats->max_cycles[FREE] = 0;
+    stats->max_cycles[REALLOC] = 0;
+    for (i = 0;  i < trace->num_ops;  i++) {
+        int type = trace->ops[i].type;
+        if (type == ALLOC_BATCH || type == ALLOC_ALIGNED || type == CALLOC)    /* a batch is one op */
+            type = ALLOC;
+        else if (type == FREE_BATCH || type == FREE_SIZED)
+            type = FREE;
+        if (best[i] > stats->max_cycles[type])
+            stats->max_cycles[type] = best[i];
+    }
+    free(best);
+}
+
+/*
+ * eval_mm_dtlb - Count the dTLB load and store misses of one run of the
+ *    trace with the hardware performance counters. The count is -1 when
+ *    perf_event_open is not available (no PMU, or not permitted).
+ */
+static int dtlb_counter(int op, int group)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (op << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = (group == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void eval_mm_dtlb(speed_t *speed_params, stats_t *stats)
+{
+    uint64_t loads = 0, stores = 0;
+    int lfd, sfd;
+
+    stats->dtlb_misses = -1;
+    if ((lfd = dtlb_counter(PERF_COUNT_HW_CACHE_OP_READ, -1)) < 0)
+        return;
+    sfd = dtlb_counter(PERF_COUNT_HW_CACHE_OP_WRITE, lfd);  /* not on every CPU */
+
+    ioctl(lfd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(lfd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    eval_mm_speed(speed_params);
+    ioctl(lfd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    if (read(lfd, &loads, sizeof(loads)) == sizeof(loads)) {
+        if (sfd >= 0 && read(sfd, &stores, sizeof(stores)) != sizeof(stores))
+            stores = 0;
+        stats->dtlb_misses = (double) (loads + stores);
+    }
+    if (sfd >= 0)
+        close(sfd);
+    close(lfd);
+}
+
+#ifdef THREAD_SAFE
+/*
+ * eval_mm_scaling - Measure how malloc/free pairs scale with threads.
+ *    Each thread keeps SCALE_SLOTS live blocks of random small sizes and
+ *    replaces a random one SCALE_PAIRS times. Every block is tagged with
+ *    its owner's id, which is checked before the block is freed, so that
+ *    blocks handed out to two threads at once are caught.
+ */
+#define SCALE_PAIRS    1000000
+#define SCALE_SLOTS    64
+#define SCALE_MAX_SIZE 256
+
+static void *scale_worker(void *arg)
+{
+    long id = (long) arg;
+    unsigned seed = (unsigned) id + 1;
+    char *slots[SCALE_SLOTS] = { NULL };
+    int i, s;
+
+    for (i = 0;  i < SCALE_PAIRS;  i++) {
+        s = rand_r(&seed) % SCALE_SLOTS;
+        if (slots[s] != NULL) {
+            if (mem_read(slots[s], 1) != (uint64_t) (id & 0xFF))
+                app_error("scaling thread %ld: block %p was clobbered\n",
+                          id, slots[s]);
+            mm_free(slots[s]);
+        }
+        if ((slots[s] = mm_malloc(1 + rand_r(&seed) % SCALE_MAX_SIZE)) == NULL)
+            app_error("scaling thread %ld: mm_malloc failed\n", id);
+        mem_write(slots[s], id & 0xFF, 1);
+    }
+    for (s = 0;  s < SCALE_SLOTS;  s++)
+        mm_free(slots[s]);
+    return NULL;
+}
+
+static double scale_run(int nthreads)
+{
+    pthread_t tids[nthreads];
+    struct timespec start, end;
+    long i;
+
+    mem_reset_brk();
+    if (!mm_init())
+        app_error("mm_init failed in eval_mm_scaling");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0;  i < nthreads;  i++)
+        if (pthread_create(&tids[i], NULL, scale_worker, (void *) i) != 0)
+            unix_error("pthread_create failed in eval_mm_scaling");
+    for (i = 0;  i < nthreads;  i++)
+        pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+}
+
+static void eval_mm_scaling(int max_threads)
+{
+    int n;
+    double base = 0;
+
+    mem_init();
+    printf("Scaling of malloc/free pairs:\n");
+    printf("  %7s%10s%9s\n", "threads", "Kops", "speedup");
+    for (n = 1;  ;  n *= 2) {   /* powers of two, then max_threads */
+        if (n > max_threads)
+            n = max_threads;
+        double secs = scale_run(n);
+        double kops = (double) n * SCALE_PAIRS * 1e-3 / secs;
+        if (n == 1)
+            base = kops;
+        printf("  %7d%10.0f%9.2f\n", n, kops, kops / base);
+        if (n == max_threads)
+            break;
+    }
+    printf("\n");
+    mem_deinit();
+}
+
+/*
+ * eval_mm_xfer - Measure frees of blocks allocated by another thread.
+ *    Each producer mallocs XFER_BLOCKS blocks of random sizes and hands
+ *    them to its consumer through a single-producer/single-consumer
+ *    ring; the consumer checks the tag and frees them. The run is done
+ *    once with cross-thread frees taking the owner's lock and once with
+ *    the lock-free remote queues.
+ */
+#define XFER_BLOCKS   1000000
+#define XFER_RING     1024
+#define XFER_MAX_SIZE 1024
+
+typedef struct {
+    long id;
+    void *ring[XFER_RING];
+    unsigned long head;         /* next slot the producer fills */
+    unsigned long tail;         /* next slot the consumer empties */
+} xfer_t;
+
+static void *xfer_producer(void *arg)
+{
+    xfer_t *x = arg;
+    unsigned seed = (unsigned) x->id + 1;
+    unsigned long i;
+
+    for (i = 0;  i < XFER_BLOCKS;  i++) {
+        char *p = mm_malloc(1 + rand_r(&seed) % XFER_MAX_SIZE);
+        if (p == NULL)
+            app_error("xfer producer %ld: mm_malloc failed\n", x->id);
+        mem_write(p, x->id & 0xFF, 1);
+        while (i - __atomic_load_n(&x->tail, __ATOMIC_ACQUIRE) >= XFER_RING)
+            sched_yield();
+        x->ring[i % XFER_RING] = p;
+        __atomic_store_n(&x->head, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void *xfer_consumer(void *arg)
+{
+    xfer_t *x = arg;
+    unsigned long i;
+
+    for (i = 0;  i < XFER_BLOCKS;  i++) {
+        while (__atomic_load_n(&x->head, __ATOMIC_ACQUIRE) == i)
+            sched_yield();
+        char *p = x->ring[i % XFER_RING];
+        __atomic_store_n(&x->tail, i + 1, __ATOMIC_RELEASE);
+        if (mem_read(p, 1) != (uint64_t) (x->id & 0xFF))
+            app_error("xfer consumer %ld: block %p was clobbered\n", x->id, p);
+        mm_free(p);
+    }
+    return NULL;
+}
+
+static double xfer_run(int npairs)
+{
+    pthread_t tids[2 * npairs];
+    xfer_t *pairs = calloc(npairs, sizeof(xfer_t));
+    struct timespec start, end;
+    int i;
+
+    if (pairs == NULL)
+        unix_error("calloc failed in eval_mm_xfer");
+    mem_reset_brk();
+    if (!mm_init())
+        app_error("mm_init failed in eval_mm_xfer");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0;  i < npairs;  i++) {
+        pairs[i].id = i;
+        if (pthread_create(&tids[2*i], NULL, xfer_producer, &pairs[i]) != 0
+            || pthread_create(&tids[2*i+1], NULL, xfer_consumer, &pairs[i]) != 0)
+            unix_error("pthread_create failed in eval_mm_xfer");
+    }
+    for (i = 0;  i < 2 * npairs;  i++)
+        pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    free(pairs);
+    return (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+}
+
+static void eval_mm_xfer(int npairs)
+{
+    double kops[2];
+    int remote;
+
+    mem_init();
+    printf("Cross-thread frees with %d producer/consumer pair(s):\n", npairs);
+    printf("  %-14s%10s%9s\n", "frees", "Kops", "speedup");
+    for (remote = 0;  remote < 2;  remote++) {
+        mm_remote_free = remote;
+        kops[remote] = (double) npairs * XFER_BLOCKS * 1e-3 / xfer_run(npairs);
+        printf("  %-14s%10.0f%9.2f\n", remote ? "remote queue" : "owner lock",
+               kops[remote], kops[remote] / kops[0]);
+    }
+    mm_remote_free = true;
+    printf("\n");
+    mem_deinit();
+}
+#endif /* THREAD_SAFE */
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1324,7 +2051,7 @@ static void eval_mm_speed(void *ptr)
  */
 static bool eval_libc_valid(trace_t *trace)
 {
-    int i;
+    int i, j;
     size_t newsize;
     char *p, *newp, *oldp;
 
@@ -1341,6 +2068,23 @@ static bool eval_libc_valid(trace_t *trace)
                 trace->blocks[trace->ops[i].index] = p;
                 break;
 
+            case CALLOC: /* calloc */
+                if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+                    malloc_error(trace, i, "libc calloc failed");
+                    unix_error("System message");
+                }
+                trace->blocks[trace->ops[i].index] = p;
+                break;
+
+            case ALLOC_ALIGNED: /* posix_memalign */
+                if (posix_memalign((void **)&p, trace->ops[i].alignment,
+                                   trace->ops[i].size) != 0) {
+                    malloc_error(trace, i, "libc posix_memalign failed");
+                    unix_error("System message");
+                }
+                trace->blocks[trace->ops[i].index] = p;
+                break;
+
             case REALLOC: /* realloc */
                 newsize = trace->ops[i].size;
                 oldp = trace->blocks[trace->ops[i].index];
@@ -1359,6 +2103,25 @@ static bool eval_libc_valid(trace_t *trace)
                 }
                 break;
 
+            case FREE_SIZED: /* free */
+                free(trace->blocks[trace->ops[i].index]);
+                break;
+
+            case ALLOC_BATCH: /* one malloc per block */
+                for (j = 0; j < trace->ops[i].count; j++) {
+                    if ((p = malloc(trace->ops[i].size)) == NULL) {
+                        malloc_error(trace, i, "libc malloc failed");
+                        unix_error("System message");
+                    }
+                    trace->blocks[trace->ops[i].index + j] = p;
+                }
+                break;
+
+            case FREE_BATCH: /* one free per block */
+                for (j = 0; j < trace->ops[i].count; j++)
+                    free(trace->blocks[trace->ops[i].index + j]);
+                break;
+
             default:
                 app_error("invalid operation type  in eval_libc_valid");
         }
@@ -1374,7 +2137,7 @@ static bool eval_libc_valid(trace_t *trace)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
+    int i, j;
     int index;
     size_t size, newsize;
     char *p, *newp, *oldp, *block;
@@ -1392,6 +2155,21 @@ static void eval_libc_speed(void *ptr)
                 trace->blocks[index] = p;
                 break;
 
+            case CALLOC: /* calloc */
+                index = trace->ops[i].index;
+                if ((p = calloc(1, trace->ops[i].size)) == NULL)
+                    unix_error("calloc failed in eval_libc_speed");
+                trace->blocks[index] = p;
+                break;
+
+            case ALLOC_ALIGNED: /* posix_memalign */
+                index = trace->ops[i].index;
+                if (posix_memalign((void **)&p, trace->ops[i].alignment,
+                                   trace->ops[i].size) != 0)
+                    unix_error("posix_memalign failed in eval_libc_speed");
+                trace->blocks[index] = p;
+                break;
+
             case REALLOC: /* realloc */
                 index = trace->ops[i].index;
                 newsize = trace->ops[i].size;
@@ -1411,6 +2189,25 @@ static void eval_libc_speed(void *ptr)
                     free(0);
                 }
                 break;
+
+            case FREE_SIZED: /* free */
+                free(trace->blocks[trace->ops[i].index]);
+                break;
+
+            case ALLOC_BATCH: /* one malloc per block */
+                index = trace->ops[i].index;
+                for (j = 0; j < trace->ops[i].count; j++) {
+                    if ((p = malloc(trace->ops[i].size)) == NULL)
+                        unix_error("malloc failed in eval_libc_speed");
+                    trace->blocks[index + j] = p;
+                }
+                break;
+
+            case FREE_BATCH: /* one free per block */
+                index = trace->ops[i].index;
+                for (j = 0; j < trace->ops[i].count; j++)
+                    free(trace->blocks[index + j]);
+                break;
         }
     }
 }
@@ -1585,6 +2382,164 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     }
 }
 
+/*
+ * printfootprint - prints the peak-based utilization next to the peak,
+ *                  final and op-averaged heap size and the number of
+ *                  heap extensions of each trace (-m).
+ */
+static void printfootprint(int n, stats_t *stats)
+{
+    int i;
+
+    if (tab_mode) {
+        printf("util	peak	final	avg	extends	trace\n");
+    } else {
+        printf("  %7s%10s%10s%10s%9s  %s\n", "util", "peak", "final", "avg",
+               "extends", "trace");
+    }
+    for (i=0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        if (tab_mode) {
+            printf("%.1f\t%.0f\t%.0f\t%.0f\t%.0f\t%s\n", stats[i].util * 100.0,
+                   stats[i].peak_heap / 1024, stats[i].final_heap / 1024,
+                   stats[i].avg_heap / 1024, stats[i].extends, stats[i].filename);
+        } else {
+            printf("  %6.1f%%%10.0f%10.0f%10.0f%9.0f  %s\n", stats[i].util * 100.0,
+                   stats[i].peak_heap / 1024, stats[i].final_heap / 1024,
+                   stats[i].avg_heap / 1024, stats[i].extends, stats[i].filename);
+        }
+    }
+}
+
+/*
+ * printdtlb - prints the dTLB misses of one run of each trace, total and
+ *             per 1000 ops, as measured with -b.
+ */
+static void printdtlb(int n, stats_t *stats)
+{
+    int i;
+
+    if (tab_mode) {
+        printf("misses\tper_kop\ttrace\n");
+    } else {
+        printf("  %12s%10s  %s\n", "misses", "per Kop", "trace");
+    }
+    for (i=0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        if (stats[i].dtlb_misses < 0) {     /* no counters on this system */
+            if (tab_mode)
+                printf("-\t-\t%s\n", stats[i].filename);
+            else
+                printf("  %12s%10s  %s\n", "n/a", "n/a", stats[i].filename);
+            continue;
+        }
+        double per_kop = stats[i].dtlb_misses * 1e3 / stats[i].ops;
+        if (tab_mode) {
+            printf("%.0f\t%.2f\t%s\n", stats[i].dtlb_misses, per_kop,
+                   stats[i].filename);
+        } else {
+            printf("  %12.0f%10.2f  %s\n", stats[i].dtlb_misses, per_kop,
+                   stats[i].filename);
+        }
+    }
+}
+
+/*
+ * printcopy - prints the bytes the allocator copied (realloc) and set
+ *             (calloc) in one run of each trace, and the copy rate in
+ *             MB/s over the time spent in those copies (-k).
+ */
+static void printcopy(int n, stats_t *stats)
+{
+    int i;
+
+    if (tab_mode) {
+        printf("copied\tset\tMB/s\ttrace\n");
+    } else {
+        printf("  %10s%10s%10s  %s\n", "copied", "set", "MB/s", "trace");
+    }
+    for (i=0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        double mbps = stats[i].copy_secs > 0 ?
+            stats[i].copy_bytes / stats[i].copy_secs / (1 << 20) : 0;
+        if (tab_mode) {
+            printf("%.0f\t%.0f\t%.1f\t%s\n", stats[i].copy_bytes / 1024,
+                   stats[i].set_bytes / 1024, mbps, stats[i].filename);
+        } else {
+            printf("  %10.0f%10.0f%10.1f  %s\n", stats[i].copy_bytes / 1024,
+                   stats[i].set_bytes / 1024, mbps, stats[i].filename);
+        }
+    }
+}
+
+/*
+ * printresident - prints the most resident heap pages and those left
+ *                 after the last op of each trace, next to the peak heap
+ *                 size in pages (-r).
+ */
+static void printresident(int n, stats_t *stats)
+{
+    int i;
+    double page = mem_pagesize();
+
+    if (tab_mode) {
+        printf("peak\tfinal\theap\ttrace\n");
+    } else {
+        printf("  %10s%10s%12s  %s\n", "peak", "final", "heap", "trace");
+    }
+    for (i=0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        if (stats[i].resident_peak < 0) {   /* dense heap */
+            if (tab_mode)
+                printf("-\t%.0f\t%.0f\t%s\n", stats[i].resident,
+                       stats[i].peak_heap / page, stats[i].filename);
+            else
+                printf("  %10s%10.0f%12.0f  %s\n", "n/a", stats[i].resident,
+                       stats[i].peak_heap / page, stats[i].filename);
+            continue;
+        }
+        if (tab_mode) {
+            printf("%.0f\t%.0f\t%.0f\t%s\n", stats[i].resident_peak,
+                   stats[i].resident, stats[i].peak_heap / page, stats[i].filename);
+        } else {
+            printf("  %10.0f%10.0f%12.0f  %s\n", stats[i].resident_peak,
+                   stats[i].resident, stats[i].peak_heap / page, stats[i].filename);
+        }
+    }
+}
+
+/*
+ * printlatency - prints the worst-case cycles of a single malloc, free
+ *                and realloc for each trace, as measured with -w.
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    int i;
+
+    if (tab_mode) {
+        printf("malloc\tfree\trealloc\ttrace\n");
+    } else {
+        printf("  %9s%9s%9s  %s\n", "malloc", "free", "realloc", "trace");
+    }
+    for (i=0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        if (tab_mode) {
+            printf("%.0f\t%.0f\t%.0f\t%s\n",
+                   stats[i].max_cycles[ALLOC], stats[i].max_cycles[FREE],
+                   stats[i].max_cycles[REALLOC], stats[i].filename);
+        } else {
+            printf("  %9.0f%9.0f%9.0f  %s\n",
+                   stats[i].max_cycles[ALLOC], stats[i].max_cycles[FREE],
+                   stats[i].max_cycles[REALLOC], stats[i].filename);
+        }
+    }
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1796,7 +2751,7 @@ static double measure_ref_throughput() {
  */
 static void usage(char *prog)
 {
-    fprintf(stderr, "Usage: %s [-hlVdD] [-f <file>]\n", prog);
+    fprintf(stderr, "Usage: %s [-hlVdDwmbkrH] [-p <n>] [-x <n>] [-f <file>]\n", prog);
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
@@ -1808,5 +2763,13 @@ static void usage(char *prog)
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-T         Print diagnostics in tab mode\n");
+    fprintf(stderr, "\t-w         Report worst-case cycles of a single op\n");
+    fprintf(stderr, "\t-m         Report final and op-averaged heap size and heap extensions\n");
+    fprintf(stderr, "\t-b         Report dTLB misses of a run of each trace\n");
+    fprintf(stderr, "\t-k         Report KB copied and set per trace and the copy rate\n");
+    fprintf(stderr, "\t-r         Report resident heap pages per trace\n");
+    fprintf(stderr, "\t-H         Back the heap with transparent huge pages\n");
+    fprintf(stderr, "\t-p <n>     Measure malloc/free scaling with 1..n threads (make threads)\n");
+    fprintf(stderr, "\t-x <n>     Measure cross-thread frees with n producer/consumer pairs (make threads)\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file\n");
 }
@@ -14,22 +14,89 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <time.h>
+#ifdef THREAD_SAFE
+#include <pthread.h>
+#endif
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
 #include "memlib.h"
 #include "config.h"
 
+#ifdef SPARSE_HEAP
+#define HEAP_SIZE SPARSE_HEAP_SIZE
+#define MAP_SIZE SPARSE_MAP_SIZE
+#define HEAP_PROT PROT_NONE			/* Contents live in the page table */
+#else
+#define HEAP_SIZE MAX_HEAP_SIZE
+#define MAP_SIZE MAX_MAP_SIZE
+#define HEAP_PROT (PROT_READ | PROT_WRITE)
+#endif
+
 /* private global variables */
-static unsigned char *heap;                 /* Starting address of heap */
-static unsigned char *mem_brk;              /* Current position of break */
+static unsigned char *heap_map;             /* Address of the heap mapping */
+static unsigned char *heap;                 /* Starting address of heap, huge page aligned */
 static unsigned char *mem_max_addr;         /* Maximum allowable heap address */
 
+/* The heap is split into MAX_ARENAS equal slices, each with its own break */
+#define ARENA_SPAN (HEAP_SIZE / MAX_ARENAS)
+static unsigned char *arena_base[MAX_ARENAS]; /* Starting address of each arena */
+static unsigned char *arena_brk[MAX_ARENAS];  /* Current break of each arena */
+static unsigned char *arena_clean[MAX_ARENAS];/* Each arena reads as zero from here up */
+
+/* Mapped regions, sorted by address, within a reservation of their own */
+typedef struct {
+    unsigned char *lo;
+    size_t size;
+} region_t;
+static unsigned char *map_base;             /* Start of the region reservation */
+static region_t regions[MAX_REGIONS];
+static size_t huge_size;                    /* Huge page size, read once */
+static bool huge_pages = false;             /* Advise the kernel to back the heap with huge pages */
+static int num_regions;
+static size_t mapped_bytes;                 /* Sum of the sizes of all regions */
+#ifdef THREAD_SAFE
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Bulk copy and fill, chosen for the CPU by mem_init */
+static void *copy_words(void *dst, const void *src, size_t n);
+static void *set_words(void *dst, int c, size_t n);
+static void *(*copy_bulk)(void *dst, const void *src, size_t n) = copy_words;
+static void *(*set_bulk)(void *dst, int c, size_t n) = set_words;
+static size_t bulk_min = SIZE_MAX;          /* shorter calls take the word loops */
+static size_t copied_bytes;                 /* Bytes moved by mem_memcpy and mem_memmove */
+static size_t set_bytes;                    /* Bytes filled by mem_memset */
+static bool time_copies = false;            /* Time mem_memcpy and mem_memmove calls */
+static size_t copy_nsecs;                   /* Nanoseconds spent in them while timed */
+static void mem_bulk_init(void);
+
+#ifdef SPARSE_HEAP
+/* Sparse heap contents: a chained hash table of the pages ever written */
+typedef struct spage {
+    uintptr_t addr;                         /* First address of the page */
+    struct spage *next;                     /* Next page in the same bucket */
+    unsigned char data[SPARSE_PAGE];
+} spage_t;
+static spage_t **page_table;                /* Buckets, a power of two of them */
+static int table_bits;                      /* log2 of the number of buckets */
+static spage_t *last_page;                  /* Page found by the last lookup */
+static size_t resident;                     /* Pages in the page table */
+static size_t resident_peak;                /* Most pages held since mem_reset_brk */
+static void pages_drop(uintptr_t lo, uintptr_t hi);
+static void pages_drop_all(void);
+#endif
+
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(){
+    size_t huge = mem_hugepagesize();
     unsigned char* addr = mmap(NULL,                                        /* start*/
-                               MAX_HEAP_SIZE,                               /* length */
-                               PROT_READ | PROT_WRITE,                      /* permissions */
+                               HEAP_SIZE + huge,                            /* length, room to align */
+                               HEAP_PROT,                                   /* permissions */
                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, /* flags */
                                -1,                                          /* fd */
                                0);                                          /* offset */
@@ -37,8 +104,21 @@ void mem_init(){
 	fprintf(stderr, "FAILURE.  mmap couldn't allocate space for heap\n");
 	exit(1);
     }
-    heap = addr;
-    mem_max_addr = addr + MAX_HEAP_SIZE;
+    heap_map = addr;
+    heap = (unsigned char *) (((uintptr_t) addr + huge - 1) & ~(uintptr_t) (huge - 1));
+    mem_max_addr = heap + HEAP_SIZE;
+    mem_set_hugepages(huge_pages);
+    for (int i = 0; i < MAX_ARENAS; i++)
+	arena_base[i] = arena_clean[i] = heap + i * ARENA_SPAN;
+    map_base = mmap(NULL, MAP_SIZE, HEAP_PROT,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map_base == MAP_FAILED) {
+	fprintf(stderr, "FAILURE.  mmap couldn't reserve space for mapped regions\n");
+	exit(1);
+    }
+    num_regions = 0;
+    mem_bulk_init();
+    copied_bytes = set_bytes = copy_nsecs = 0;
     mem_reset_brk();
 }
 
@@ -46,38 +126,79 @@ void mem_init(){
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
-    if (munmap(heap, MAX_HEAP_SIZE) != 0) {
+    if (munmap(heap_map, HEAP_SIZE + mem_hugepagesize()) != 0) {
         fprintf(stderr, "FAILURE.  munmap couldn't deallocate heap space\n");
         exit(1);
     }
+    if (munmap(map_base, MAP_SIZE) != 0) {
+        fprintf(stderr, "FAILURE.  munmap couldn't deallocate mapped regions\n");
+        exit(1);
+    }
+    heap = NULL;
+#ifdef SPARSE_HEAP
+    pages_drop_all();
+    free(page_table);
+    page_table = NULL;
+    table_bits = 0;
+#endif
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointers to make an empty heap,
+ *		and unmap every mapped region
  */
 void mem_reset_brk(){
-    mem_brk = heap;
+    for (int i = 0; i < MAX_ARENAS; i++)
+	arena_brk[i] = arena_base[i];
+#ifdef SPARSE_HEAP
+    pages_drop_all();			/* Nothing is left behind to read back */
+    resident_peak = 0;
+    for (int i = 0; i < MAX_ARENAS; i++)
+	arena_clean[i] = arena_base[i];
+#else
+    for (int i = 0; i < num_regions; i++)
+	madvise(regions[i].lo, regions[i].size, MADV_DONTNEED);
+#endif
+    num_regions = 0;
+    mapped_bytes = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ *		by incr bytes and returns the start address of the new area, or
+ *		shrinks it when incr is negative and returns the old break.
  */
 void *mem_sbrk(intptr_t incr) {
-    unsigned char *old_brk = mem_brk;
+    return mem_arena_sbrk(0, incr);
+}
+
+/*
+ * mem_arena_sbrk - mem_sbrk for one arena.  Arenas never share state, so
+ *		callers working on different arenas need no common lock.
+ */
+void *mem_arena_sbrk(int arena, intptr_t incr) {
+    unsigned char *old_brk = arena_brk[arena];
+    unsigned char *limit = arena_base[arena] + ARENA_SPAN;
 
     bool ok = true;
-    if (incr < 0) {
+    if (incr < 0 && (size_t) -incr > (size_t) (old_brk - arena_base[arena])) {
 	ok = false;
-	fprintf(stderr, "ERROR: mem_sbrk failed.  Attempt to expand heap by negative value %ld\n", (long) incr);
-    } else if (mem_brk + incr > mem_max_addr) {
+	fprintf(stderr, "ERROR: mem_sbrk failed.  Attempt to shrink heap by %ld below its start\n", (long) -incr);
+    } else if (old_brk + incr > limit) {
 	ok = false;
-	long alloc = mem_brk - heap + incr;
+	long alloc = old_brk - arena_base[arena] + incr;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory.  Would require heap size of %zd (0x%zx) bytes\n", alloc, alloc);
     }
     if (ok) {
-	mem_brk += incr;
+	arena_brk[arena] += incr;
+	if (incr < 0) {			/* Give back the whole pages above the new break */
+	    uintptr_t page = mem_pagesize();
+	    unsigned char *hi = (unsigned char *) ((uintptr_t) old_brk & ~(page - 1));
+	    size_t len = mem_decommit(arena_brk[arena], -incr);
+	    if (len > 0 && hi == arena_clean[arena])	/* zero again up to the clean part */
+		arena_clean[arena] = hi - len;
+	} else if (arena_brk[arena] > arena_clean[arena])
+	    arena_clean[arena] = arena_brk[arena];
 	return (void *) old_brk;
     } else {
 	errno = ENOMEM;
@@ -85,6 +206,146 @@ void *mem_sbrk(intptr_t incr) {
     }
 }
 
+/*
+ * mem_arena_clean - lowest address from which the arena reads as zero:
+ *		memory above every break the arena has had, or given back
+ *		since.  mem_reset_brk leaves it alone in the dense heap, so
+ *		memory a previous heap used is never taken for zero; the
+ *		sparse heap drops every page there and starts clean.
+ */
+void *mem_arena_clean(int arena) {
+    return arena_clean[arena];
+}
+
+/*
+ * mem_arena_count - number of arenas available to mem_arena_sbrk
+ */
+int mem_arena_count(void) {
+    return MAX_ARENAS;
+}
+
+/*
+ * mem_arena_of - index of the arena holding address p, or -1
+ */
+int mem_arena_of(const void *p) {
+    const unsigned char *cp = (const unsigned char *) p;
+    if (cp < heap || cp >= mem_max_addr)
+	return -1;
+    return (int) ((size_t) (cp - heap) / ARENA_SPAN);
+}
+
+/*
+ * mem_arena_lo, mem_arena_hi - first and last byte in use in an arena
+ */
+void *mem_arena_lo(int arena) {
+    return (void *) arena_base[arena];
+}
+
+void *mem_arena_hi(int arena) {
+    return (void *) (arena_brk[arena] - 1);
+}
+
+/*
+ * mem_map - simple model of an anonymous mmap.  Maps a zero-filled,
+ *		page-aligned region of at least size bytes outside the arenas
+ *		and returns its address, or (void *) -1 on failure.
+ */
+void *mem_map(size_t size) {
+    size_t page = mem_pagesize();
+    unsigned char *lo = map_base;
+    void *result = (void *) -1;
+    int i;
+
+    size = (size + page - 1) / page * page;
+#ifdef THREAD_SAFE
+    pthread_mutex_lock(&map_lock);
+#endif
+    for (i = 0; i < num_regions; i++) {	/* First gap that fits */
+	if ((size_t) (regions[i].lo - lo) >= size)
+	    break;
+	lo = regions[i].lo + regions[i].size;
+    }
+    if (size == 0 || num_regions == MAX_REGIONS
+	|| (size_t) (map_base + MAP_SIZE - lo) < size) {
+	fprintf(stderr, "ERROR: mem_map failed.  Could not map %zu bytes\n", size);
+	errno = ENOMEM;
+    } else {
+	memmove(&regions[i + 1], &regions[i], (num_regions - i) * sizeof(region_t));
+	regions[i].lo = lo;
+	regions[i].size = size;
+	num_regions++;
+	mapped_bytes += size;
+	result = lo;
+    }
+#ifdef THREAD_SAFE
+    pthread_mutex_unlock(&map_lock);
+#endif
+    return result;
+}
+
+/*
+ * mem_unmap - unmap a region returned by mem_map.  The whole region must
+ *		be unmapped at once.  Returns 0 on success, -1 on failure.
+ */
+int mem_unmap(void *addr, size_t size) {
+    size_t page = mem_pagesize();
+    int result = -1;
+    int i;
+
+    size = (size + page - 1) / page * page;
+#ifdef THREAD_SAFE
+    pthread_mutex_lock(&map_lock);
+#endif
+    for (i = 0; i < num_regions; i++)
+	if (regions[i].lo == addr && regions[i].size == size)
+	    break;
+    if (i == num_regions) {
+	fprintf(stderr, "ERROR: mem_unmap failed.  No region of %zu bytes at %p\n", size, addr);
+	errno = EINVAL;
+    } else {
+#ifdef SPARSE_HEAP
+	pages_drop((uintptr_t) addr, (uintptr_t) addr + size);
+#else
+	madvise(addr, size, MADV_DONTNEED);	/* Give the pages back, zero-filled on reuse */
+#endif
+	mapped_bytes -= size;
+	num_regions--;
+	memmove(&regions[i], &regions[i + 1], (num_regions - i) * sizeof(region_t));
+	result = 0;
+    }
+#ifdef THREAD_SAFE
+    pthread_mutex_unlock(&map_lock);
+#endif
+    return result;
+}
+
+/*
+ * mem_mapsize - total bytes currently mapped with mem_map
+ */
+size_t mem_mapsize(void) {
+    return mapped_bytes;
+}
+
+/*
+ * mem_is_mapped - whether lo..hi (inclusive) lies within a single mapped region
+ */
+bool mem_is_mapped(const void *lo, const void *hi) {
+    const unsigned char *clo = (const unsigned char *) lo;
+    const unsigned char *chi = (const unsigned char *) hi;
+    int l = 0, h = num_regions - 1;
+
+    while (l <= h) {			/* Binary search for the region holding lo */
+	int m = (l + h) / 2;
+	if (clo < regions[m].lo)
+	    h = m - 1;
+	else if (clo >= regions[m].lo + regions[m].size)
+	    l = m + 1;
+	else
+	    return chi >= clo && chi < regions[m].lo + regions[m].size;
+    }
+    return false;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -93,17 +354,82 @@ void *mem_heap_lo(){
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_heap_hi - return address of last heap byte, in the highest arena in use
  */
 void *mem_heap_hi(){
-    return (void *)(mem_brk - 1);
+    unsigned char *hi = arena_brk[0];
+    for (int i = 1; i < MAX_ARENAS; i++)
+	if (arena_brk[i] != arena_base[i])
+	    hi = arena_brk[i];
+    return (void *)(hi - 1);
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_heapsize() - returns the heap size in bytes, summed over all arenas
  */
 size_t mem_heapsize() {
-    return (size_t)(mem_brk - heap);
+    size_t size = 0;
+    for (int i = 0; i < MAX_ARENAS; i++)
+	size += (size_t)(arena_brk[i] - arena_base[i]);
+    return size;
+}
+
+/*
+ * mem_hugepagesize() - returns the transparent huge page size of the
+ *		system, or 2 MB if the kernel does not report one
+ */
+size_t mem_hugepagesize(void) {
+    if (huge_size == 0) {
+	FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+	unsigned long size = 0;
+	if (fp != NULL) {
+	    if (fscanf(fp, "%lu", &size) != 1)
+		size = 0;
+	    fclose(fp);
+	}
+	huge_size = size ? size : 2 * 1024 * 1024;
+    }
+    return huge_size;
+}
+
+/*
+ * mem_set_hugepages - advise (or stop advising) the kernel to back the
+ *		heap with transparent huge pages.  The setting survives
+ *		mem_deinit and applies to every later mem_init.
+ */
+void mem_set_hugepages(bool on) {
+    huge_pages = on;
+#ifdef MADV_HUGEPAGE
+    if (heap != NULL)
+	madvise(heap, HEAP_SIZE, on ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#endif
+}
+
+/*
+ * mem_hugepages - whether the heap is advised to use huge pages
+ */
+bool mem_hugepages(void) {
+    return huge_pages;
+}
+
+/*
+ * mem_decommit - simple model of madvise(MADV_DONTNEED).  Releases the
+ *		whole pages inside addr..addr+len-1, which read as zero when
+ *		touched again.  Returns the number of bytes released.
+ */
+size_t mem_decommit(void *addr, size_t len) {
+    uintptr_t page = mem_pagesize();
+    uintptr_t lo = ((uintptr_t) addr + page - 1) & ~(page - 1);
+    uintptr_t hi = ((uintptr_t) addr + len) & ~(page - 1);
+
+    if (lo >= hi)
+	return 0;
+#ifdef SPARSE_HEAP
+    pages_drop(lo, hi);
+#else
+    madvise((void *) lo, hi - lo, MADV_DONTNEED);
+#endif
+    return hi - lo;
 }
 
 /*
@@ -115,9 +441,138 @@ size_t mem_pagesize(){
 
 /*************** Memory emulation  *******************/
 
+/* Whether addr lies in the sparse heap, which only mem_read and mem_write reach */
+static bool is_sparse(const void *addr) {
+#ifdef SPARSE_HEAP
+    const unsigned char *cp = (const unsigned char *) addr;
+    return (cp >= heap && cp < mem_max_addr)
+	|| (cp >= map_base && cp < map_base + MAP_SIZE);
+#else
+    return false;
+#endif
+}
+
+#ifdef SPARSE_HEAP
+/*
+ * Sparse heap page table.  Pages are chained in buckets hashed on their
+ * address, and the table doubles once it holds as many pages as it has
+ * buckets.  A page that was never written reads as zero.
+ */
+static size_t page_hash(uintptr_t addr) {
+    return (size_t) (((addr / SPARSE_PAGE) * 0x9E3779B97F4A7C15ull) >> (64 - table_bits));
+}
+
+/* page_find - the page starting at addr, or NULL if it was never written */
+static spage_t *page_find(uintptr_t addr) {
+    spage_t *pg;
+    if (last_page != NULL && last_page->addr == addr)
+	return last_page;
+    if (page_table == NULL)
+	return NULL;
+    for (pg = page_table[page_hash(addr)]; pg != NULL; pg = pg->next)
+	if (pg->addr == addr)
+	    return last_page = pg;
+    return NULL;
+}
+
+static void table_grow(void) {
+    int old_bits = table_bits;
+    spage_t **old = page_table;
+    table_bits = old_bits ? old_bits + 1 : 12;
+    page_table = calloc((size_t) 1 << table_bits, sizeof(spage_t *));
+    if (page_table == NULL) {
+	fprintf(stderr, "FAILURE.  calloc couldn't grow the sparse page table\n");
+	exit(1);
+    }
+    for (size_t i = 0; old != NULL && i < (size_t) 1 << old_bits; i++) {
+	while (old[i] != NULL) {
+	    spage_t *pg = old[i];
+	    size_t h = page_hash(pg->addr);
+	    old[i] = pg->next;
+	    pg->next = page_table[h];
+	    page_table[h] = pg;
+	}
+    }
+    free(old);
+}
+
+/* page_make - the page starting at addr, zero-filled if it is new */
+static spage_t *page_make(uintptr_t addr) {
+    spage_t *pg = page_find(addr);
+    if (pg != NULL)
+	return pg;
+    if (page_table == NULL || resident >= ((size_t) 1 << table_bits))
+	table_grow();
+    if ((pg = calloc(1, sizeof(spage_t))) == NULL) {
+	fprintf(stderr, "FAILURE.  calloc couldn't allocate a sparse heap page\n");
+	exit(1);
+    }
+    size_t h = page_hash(addr);
+    pg->addr = addr;
+    pg->next = page_table[h];
+    page_table[h] = pg;
+    if (++resident > resident_peak)
+	resident_peak = resident;
+    return last_page = pg;
+}
+
+/* pages_drop - free the pages starting in lo..hi-1, which read as zero again */
+static void pages_drop(uintptr_t lo, uintptr_t hi) {
+    if (resident == 0)
+	return;
+    last_page = NULL;
+    if ((hi - lo) / SPARSE_PAGE <= resident) {	/* Look up each page of the range */
+	for (uintptr_t addr = lo; addr < hi; addr += SPARSE_PAGE) {
+	    spage_t **link = &page_table[page_hash(addr)];
+	    while (*link != NULL && (*link)->addr != addr)
+		link = &(*link)->next;
+	    if (*link != NULL) {
+		spage_t *pg = *link;
+		*link = pg->next;
+		free(pg);
+		resident--;
+	    }
+	}
+	return;
+    }
+    for (size_t i = 0; i < (size_t) 1 << table_bits; i++) {	/* Or sweep the table */
+	spage_t **link = &page_table[i];
+	while (*link != NULL) {
+	    spage_t *pg = *link;
+	    if (pg->addr >= lo && pg->addr < hi) {
+		*link = pg->next;
+		free(pg);
+		resident--;
+	    } else
+		link = &pg->next;
+	}
+    }
+}
+
+static void pages_drop_all(void) {
+    pages_drop(0, UINTPTR_MAX & ~(uintptr_t) (SPARSE_PAGE - 1));
+}
+#endif /* SPARSE_HEAP */
+
 /* Read len bytes and return value zero-extended to 64 bits */
 uint64_t mem_read(const void *addr, size_t len) {
     uint64_t rdata;
+#ifdef SPARSE_HEAP
+    if (is_sparse(addr)) {
+	uintptr_t a = (uintptr_t) addr;
+	size_t off = a % SPARSE_PAGE;
+	rdata = 0;
+	if (off + len > SPARSE_PAGE) {		/* Straddles two pages */
+	    size_t part = SPARSE_PAGE - off;
+	    return mem_read(addr, part)
+		| mem_read((const unsigned char *) addr + part, len - part) << (8 * part);
+	}
+	spage_t *pg = page_find(a - off);
+	if (pg != NULL)
+	    memcpy(&rdata, pg->data + off, len);
+	return rdata;
+    }
+#endif
     /* Dense or non-heap read */
     rdata = *(uint64_t *) addr;
     if (len < sizeof(uint64_t)) {
@@ -129,6 +584,24 @@ uint64_t mem_read(const void *addr, size_t len) {
 
 /* Write lower order len bytes of val to address */
 void mem_write(void *addr, uint64_t val, size_t len) {
+#ifdef SPARSE_HEAP
+    if (is_sparse(addr)) {
+	uintptr_t a = (uintptr_t) addr;
+	size_t off = a % SPARSE_PAGE;
+	if (off + len > SPARSE_PAGE) {		/* Straddles two pages */
+	    size_t part = SPARSE_PAGE - off;
+	    mem_write(addr, val, part);
+	    mem_write((unsigned char *) addr + part, val >> (8 * part), len - part);
+	    return;
+	}
+	if (len < sizeof(uint64_t))
+	    val &= ((uint64_t) 1 << (8 * len)) - 1;
+	spage_t *pg = val != 0 ? page_make(a - off) : page_find(a - off);
+	if (pg != NULL)				/* Zeros need no page of their own */
+	    memcpy(pg->data + off, &val, len);
+	return;
+    }
+#endif
     /* Dense or non-heap write */
     if (len == sizeof(uint64_t))
         *(uint64_t *) addr = val;
@@ -136,8 +609,22 @@ void mem_write(void *addr, uint64_t val, size_t len) {
         memcpy(addr, (void *) &val, len);
 }
 
-/* Emulation of memcpy */
-void *mem_memcpy(void *dst, const void *src, size_t n) {
+/*
+ * Bulk copy and fill.  The word loops move 8 bytes at a time.  On x86-64
+ * the SSE2 and AVX2 versions store one unaligned vector at each end and
+ * aligned vectors in between, loading both ends before anything is
+ * stored, so a forward copy into an overlapping lower destination still
+ * works.  Calls of STREAM_MIN bytes or more use non-temporal stores.
+ */
+static void count_bytes(size_t *counter, size_t n) {
+#ifdef THREAD_SAFE
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+#else
+    *counter += n;
+#endif
+}
+
+static void *copy_words(void *dst, const void *src, size_t n) {
     void *savedst = dst;
     size_t w = sizeof(uint64_t);
     while (n >= w) {
@@ -154,8 +641,7 @@ void *mem_memcpy(void *dst, const void *src, size_t n) {
     return savedst;
 }
 
-/* Emulation of memset */
-void *mem_memset(void *dst, int c, size_t n) {
+static void *set_words(void *dst, int c, size_t n) {
     void *savedst = dst;
     uint64_t byte = c & 0xFF;
     uint64_t data = 0;
@@ -175,6 +661,250 @@ void *mem_memset(void *dst, int c, size_t n) {
     return savedst;
 }
 
+#ifdef __x86_64__
+/* n >= 16 */
+static void *copy_sse2(void *dst, const void *src, size_t n) {
+    unsigned char *d = dst, *end = d + n - 16;
+    const unsigned char *s = src;
+    __m128i head = _mm_loadu_si128((const __m128i *) s);
+    __m128i tail = _mm_loadu_si128((const __m128i *) (s + n - 16));
+    size_t skip = 16 - ((uintptr_t) d & 15);	/* to the first aligned store */
+    unsigned char *p = d + skip;
+    const unsigned char *q = s + skip;
+
+    if (n >= STREAM_MIN) {
+	for (; p < end; p += 16, q += 16)
+	    _mm_stream_si128((__m128i *) p, _mm_loadu_si128((const __m128i *) q));
+	_mm_sfence();
+    } else {
+	for (; p < end; p += 16, q += 16)
+	    _mm_store_si128((__m128i *) p, _mm_loadu_si128((const __m128i *) q));
+    }
+    _mm_storeu_si128((__m128i *) d, head);
+    _mm_storeu_si128((__m128i *) end, tail);
+    return dst;
+}
+
+static void *set_sse2(void *dst, int c, size_t n) {
+    unsigned char *d = dst, *end = d + n - 16;
+    __m128i v = _mm_set1_epi8((char) c);
+    unsigned char *p = d + 16 - ((uintptr_t) d & 15);
+
+    _mm_storeu_si128((__m128i *) d, v);
+    if (n >= STREAM_MIN) {
+	for (; p < end; p += 16)
+	    _mm_stream_si128((__m128i *) p, v);
+	_mm_sfence();
+    } else {
+	for (; p < end; p += 16)
+	    _mm_store_si128((__m128i *) p, v);
+    }
+    _mm_storeu_si128((__m128i *) end, v);
+    return dst;
+}
+
+/* n >= 32; shorter calls take the SSE2 version */
+__attribute__((target("avx2")))
+static void *copy_avx2(void *dst, const void *src, size_t n) {
+    if (n < 32)
+	return copy_sse2(dst, src, n);
+    unsigned char *d = dst, *end = d + n - 32;
+    const unsigned char *s = src;
+    __m256i head = _mm256_loadu_si256((const __m256i *) s);
+    __m256i tail = _mm256_loadu_si256((const __m256i *) (s + n - 32));
+    size_t skip = 32 - ((uintptr_t) d & 31);
+    unsigned char *p = d + skip;
+    const unsigned char *q = s + skip;
+
+    if (n >= STREAM_MIN) {
+	for (; p < end; p += 32, q += 32)
+	    _mm256_stream_si256((__m256i *) p, _mm256_loadu_si256((const __m256i *) q));
+	_mm_sfence();
+    } else {
+	for (; p < end; p += 32, q += 32)
+	    _mm256_store_si256((__m256i *) p, _mm256_loadu_si256((const __m256i *) q));
+    }
+    _mm256_storeu_si256((__m256i *) d, head);
+    _mm256_storeu_si256((__m256i *) end, tail);
+    return dst;
+}
+
+__attribute__((target("avx2")))
+static void *set_avx2(void *dst, int c, size_t n) {
+    if (n < 32)
+	return set_sse2(dst, c, n);
+    unsigned char *d = dst, *end = d + n - 32;
+    __m256i v = _mm256_set1_epi8((char) c);
+    unsigned char *p = d + 32 - ((uintptr_t) d & 31);
+
+    _mm256_storeu_si256((__m256i *) d, v);
+    if (n >= STREAM_MIN) {
+	for (; p < end; p += 32)
+	    _mm256_stream_si256((__m256i *) p, v);
+	_mm_sfence();
+    } else {
+	for (; p < end; p += 32)
+	    _mm256_store_si256((__m256i *) p, v);
+    }
+    _mm256_storeu_si256((__m256i *) end, v);
+    return dst;
+}
+#endif /* __x86_64__ */
+
+/*
+ * mem_bulk_init - pick the widest copy and fill this CPU supports
+ */
+static void mem_bulk_init(void) {
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+	copy_bulk = copy_avx2;
+	set_bulk = set_avx2;
+    } else {
+	copy_bulk = copy_sse2;		/* every x86-64 CPU has SSE2 */
+	set_bulk = set_sse2;
+    }
+    bulk_min = 16;
+#endif
+}
+
+static size_t now_nsecs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (size_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *copy_forward(void *dst, const void *src, size_t n) {
+    if (n >= bulk_min && !is_sparse(dst) && !is_sparse(src))
+	return copy_bulk(dst, src, n);
+    return copy_words(dst, src, n);
+}
+
+static void *copy_backward(void *dst, const void *src, size_t n) {
+    size_t w = sizeof(uint64_t);
+    unsigned char *d = (unsigned char *) dst + n;
+    const unsigned char *s = (const unsigned char *) src + n;
+    while (n >= w) {
+	d -= w;
+	s -= w;
+	n -= w;
+	mem_write(d, mem_read(s, w), w);
+    }
+    if (n) {
+	mem_write(dst, mem_read(src, n), n);
+    }
+    return dst;
+}
+
+/* Copy by either direction, adding the time taken when timing copies */
+static void *copy_timed(void *dst, const void *src, size_t n,
+			void *(*copy)(void *, const void *, size_t)) {
+    count_bytes(&copied_bytes, n);
+    if (!time_copies)
+	return copy(dst, src, n);
+    size_t start = now_nsecs();
+    copy(dst, src, n);
+    count_bytes(&copy_nsecs, now_nsecs() - start);
+    return dst;
+}
+
+/* Emulation of memcpy */
+void *mem_memcpy(void *dst, const void *src, size_t n) {
+    return copy_timed(dst, src, n, copy_forward);
+}
+
+/* Emulation of memmove: like mem_memcpy, but the regions may overlap */
+void *mem_memmove(void *dst, const void *src, size_t n) {
+    if (dst <= src || (unsigned char *) dst >= (unsigned char *) src + n)
+	return copy_timed(dst, src, n, copy_forward); /* Forward copy never clobbers unread bytes */
+    /* Destination overlaps the tail of the source: copy backward */
+    return copy_timed(dst, src, n, copy_backward);
+}
+
+/* Emulation of memset */
+void *mem_memset(void *dst, int c, size_t n) {
+    count_bytes(&set_bytes, n);
+    if (n >= bulk_min && !is_sparse(dst))
+	return set_bulk(dst, c, n);
+    return set_words(dst, c, n);
+}
+
+/*
+ * mem_copied_bytes, mem_set_bytes - bytes copied by mem_memcpy and
+ *		mem_memmove, and filled by mem_memset, since mem_init
+ */
+size_t mem_copied_bytes(void) {
+    return copied_bytes;
+}
+
+size_t mem_set_bytes(void) {
+    return set_bytes;
+}
+
+/*
+ * mem_set_copy_timing - time (or stop timing) each mem_memcpy and
+ *		mem_memmove call.  Off by default, since reading the clock
+ *		costs more than most small copies.
+ */
+void mem_set_copy_timing(bool on) {
+    time_copies = on;
+}
+
+/*
+ * mem_copy_secs - seconds spent in timed copies since mem_init
+ */
+double mem_copy_secs(void) {
+    return copy_nsecs / 1e9;
+}
+
+/* Resident pages of the dense range lo..lo+len-1, from mincore */
+static size_t resident_in(unsigned char *lo, size_t len) {
+    static unsigned char vec[4096];
+    size_t page = mem_pagesize();
+    size_t count = 0;
+    while (len > 0) {
+	size_t chunk = len < sizeof(vec) * page ? len : sizeof(vec) * page;
+	if (mincore(lo, chunk, vec) == 0)
+	    for (size_t i = 0; i < (chunk + page - 1) / page; i++)
+		count += vec[i] & 1;
+	lo += chunk;
+	len -= chunk;
+    }
+    return count;
+}
+
+/*
+ * mem_resident_pages - pages of memory currently backing the heap and
+ *		the mapped regions.  The sparse heap counts its page table;
+ *		the dense heap asks the kernel about every page below the
+ *		clean point of each arena, and every region, which takes
+ *		time in proportion to the heap size.
+ */
+size_t mem_resident_pages(void) {
+#ifdef SPARSE_HEAP
+    return resident;
+#else
+    size_t count = 0;
+    for (int i = 0; i < MAX_ARENAS; i++)
+	count += resident_in(arena_base[i], arena_clean[i] - arena_base[i]);
+    for (int i = 0; i < num_regions; i++)
+	count += resident_in(regions[i].lo, regions[i].size);
+    return count;
+#endif
+}
+
+/*
+ * mem_resident_peak - most pages the sparse heap has held since
+ *		mem_reset_brk, or 0 for the dense heap, which cannot tell
+ */
+size_t mem_resident_peak(void) {
+#ifdef SPARSE_HEAP
+    return resident_peak;
+#else
+    return 0;
+#endif
+}
+
 /* Function to aid in viewing contents of heap */
 void hprobe(void *ptr, int offset, size_t count) {
     unsigned char *cptr = (unsigned char *) ptr;
@@ -10,6 +10,31 @@ void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_decommit(void *addr, size_t len);
+
+/* Transparent huge pages for the heap */
+size_t mem_hugepagesize(void);
+void mem_set_hugepages(bool on);
+bool mem_hugepages(void);
+
+/* Independent arenas, each a separate heap with its own break */
+int mem_arena_count(void);
+void *mem_arena_sbrk(int arena, intptr_t incr);
+int mem_arena_of(const void *p);
+void *mem_arena_lo(int arena);
+void *mem_arena_hi(int arena);
+void *mem_arena_clean(int arena);
+
+/* Page-aligned regions mapped outside the arenas */
+void *mem_map(size_t size);
+int mem_unmap(void *addr, size_t size);
+size_t mem_mapsize(void);
+bool mem_is_mapped(const void *lo, const void *hi);
+
+/* Pages backing the heap and regions: now, and at most since mem_reset_brk
+   (the peak is only kept for the sparse heap, 0 otherwise) */
+size_t mem_resident_pages(void);
+size_t mem_resident_peak(void);
 
 /* Functions used for memory emulation */
 
@@ -24,8 +49,20 @@ void mem_write(void *addr, uint64_t val, size_t len);
 /* Emulation of memcpy */
 void *mem_memcpy(void *dst, const void *src, size_t n);
 
+/* Emulation of memmove */
+void *mem_memmove(void *dst, const void *src, size_t n);
+
 /* Emulation of memset */
 void *mem_memset(void *dst, int c, size_t n);
 
+/* Bytes copied by mem_memcpy and mem_memmove, and set by mem_memset,
+   since mem_init */
+size_t mem_copied_bytes(void);
+size_t mem_set_bytes(void);
+
+/* Time the copies above, and the seconds they took since mem_init */
+void mem_set_copy_timing(bool on);
+double mem_copy_secs(void);
+
 /* Debugging function to view region of heap */
 void hprobe(void *ptr, int offset, size_t count);
@@ -9,19 +9,35 @@
  *      heap of free blocks. 
  *      Malloc is an application that requests a block of size bytes.
  *      Upon checking for invalid requests, the requested block size
- *      is adjusted to allow room for the header and footer, while 
- *      satisfying the double-word alignment. A minimum block size of
- *      16 is enforced, 8 bytes for the alignment and another 8 for the
- *      header and footer. Any request greater than 8 bytes is added with
- *      the header/footer bytes and rounded to the nearest multiple of 8.
- *      Once it has adjusted to the correct size, it searches for the free 
- *      list for a suitable free block. If there is a fit, the block is
- *      placed and any excess is split. Finally, the address of the new 
- *      block is returned. If there is no fit, the heap is extended with 
- *      a new free block and places the requested block in that free block.
+ *      is adjusted to allow room for the header, while satisfying the
+ *      double-word alignment. Allocated blocks have no footer; instead
+ *      each header records whether the previous block is allocated.
+ *      Requests of up to 128 bytes come from slab runs: page-sized
+ *      runs of equal header-less slots, one 16-byte class per run,
+ *      whose free slots are tracked in a bitmap. A slot is recognized
+ *      on free by its address alone. Split remainders of 16 bytes
+ *      become mini blocks, which live on their own doubly-linked free
+ *      list, its links packed into the one payload word. Requests of
+ *      1 MB or more are mapped in a region of their own outside the
+ *      heap. memalign places the block at an aligned address inside a
+ *      free block and frees the bytes in front of it. Every so often
+ *      the whole pages inside large free blocks are handed back to the
+ *      system. Free blocks known to read as zero are marked, so calloc
+ *      does not clear them again. Heap blocks other than mini blocks
+ *      are at least 32 bytes, so that the block can hold the free-list
+ *      links and footer once it is freed. Any larger request is added
+ *      with the header bytes and rounded to the nearest multiple of 16.
+ *      Once it has adjusted to the correct size, it searches the
+ *      segregated free lists, starting at the size class of the
+ *      request, for a suitable free block. If there is a fit, the block
+ *      is placed and any excess is split. Finally, the address of the
+ *      new block is returned. If there is no fit, the heap is extended
+ *      with a new free block and places the requested block in that
+ *      free block.
  * We reference our work from the textbook.
  */
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +45,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifdef THREAD_SAFE
+#include <pthread.h>
+#endif
+
 #include "mm.h"
 #include "memlib.h"
 
@@ -56,19 +76,147 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
 #define memset mem_memset
 #define memcpy mem_memcpy
+#define memmove mem_memmove
 #endif /* DRIVER */
 
 /* What is the correct alignment? */
 #define ALIGNMENT 16
 
 
-static char *heap_listp;		// heap pointer
-static char *freePtr = 0;		// free list ptr = start of explicit list
+/*
+ * Free blocks are kept in segregated lists, one per size class.
+ * Classes up to LINEAR_MAX are exact (one class per 16-byte size),
+ * larger classes each cover one power-of-two range (2^k, 2^(k+1)].
+ * A one-word bitmap records which lists are non-empty, so the search
+ * jumps to the next usable class with a single find-first-set. Blocks
+ * above 1 KB share the last class, which is an intrusive splay tree
+ * keyed by (size, address): a best fit in O(log n) amortized time, ties
+ * going to the lowest address.
+ *
+ * The other lists are LIFO. Building with -DADDRESS_ORDER keeps them in
+ * splay trees keyed by address instead, so a free is inserted in
+ * O(log n) amortized time and every search takes the lowest fitting
+ * address of its class, packing live blocks towards the bottom of the
+ * heap. Mini blocks have room for one link and stay LIFO.
+ *
+ * Building with -DTLSF switches to a two-level segregated fit index:
+ * each power-of-two range (first level) is split into SL_COUNT linear
+ * second-level classes, and a bitmap per level records which lists are
+ * non-empty, so insert, remove and lookup are all constant time. That
+ * build bounds every malloc and free to a constant number of list and
+ * bitmap steps, plus at most one extend_heap or trim: it has no slab
+ * runs, no quick lists to flush and no scavenger, and aligned requests
+ * take one lookup for a block large enough for any padding.
+ */
+#ifdef TLSF
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_COUNT 40
+#define SMALL_BLOCK (1 << (SL_LOG2 + 4))	// below this, one class per 16 bytes
+#define NUM_CLASSES (FL_COUNT * SL_COUNT)
+#else
+#define NUM_CLASSES 18			// the last class takes every block above 1 KB
+#define LINEAR_MAX 256
+#define TREE_CLASS (NUM_CLASSES - 1)	// and keeps it in a splay tree, not a list
+#endif
+#if defined(TLSF) && defined(ADDRESS_ORDER)
+#error "ADDRESS_ORDER applies to the segregated fit index only"
+#endif
+#if defined(THREAD_SAFE) && defined(SPARSE_HEAP)
+#error "the sparse heap has no atomic access for the thread-safe build"
+#endif
+
+/*
+ * Each arena is an independent heap in its own memlib arena, with its
+ * own free lists. The single-threaded build uses only arena 0; the
+ * thread-safe build gives every arena a lock and spreads threads over
+ * NUM_ARENAS of them. A block belongs to the arena whose address range
+ * holds it (mem_arena_of), so frees always find their way home.
+ */
+#ifdef THREAD_SAFE
+#define NUM_ARENAS 4
+#else
+#define NUM_ARENAS 1
+#endif
+
+#ifdef TLSF
+#define QUICK_MAX 0			// no quick lists: a flush would visit every one of them
+#else
+#define QUICK_MAX 512			// freed blocks up to this size go to quick lists first
+#endif
+#define QUICK_CLASSES (QUICK_MAX / 16 + 1)	// one quick list per 16-byte block size
+#define QUICK_LIMIT 16			// a quick list this long is flushed
+
+#define SLAB_MAX 128			// requests up to this many bytes come from slab runs
+#define SLAB_CLASSES (SLAB_MAX / 16)	// one run class per 16 bytes
+#define RUN_SIZE 4096			// bytes per run, runs are RUN_SIZE aligned
+#define RUN_HDR 64			// bytes of run header before the first slot
+#define RUN_WORDS 4			// bitmap words, enough for (RUN_SIZE - RUN_HDR) / 16 slots
+#define RUN_MAP_WORDS ((1ULL << 32) / RUN_SIZE / 64)	// runs are carved in the first 4 GB of an arena
+
+typedef struct run {			// lives in the heap: every field is a word, read with GET_FIELD
+	struct run *next;		// next run of the same class with a free slot
+	struct run *prev;		// previous one, NULL at the list head
+	size_t size;			// slot size of the class
+	size_t nfree;			// number of free slots
+	uint64_t bitmap[RUN_WORDS];	// bit i set if slot i is free
+} run_t;
+
+typedef struct {
+	char *heap_listp;		// heap pointer
+	char *freeLists[NUM_CLASSES];	// heads of the segregated free lists
+	char *miniList;			// doubly-linked list of free 16-byte mini blocks
+	run_t *runs[SLAB_CLASSES];	// runs of each class with at least one free slot
+	uint64_t runMap[RUN_MAP_WORDS];	// bit p set if page p of the arena holds a run
+	size_t runMapEnd;		// no bit at or above this page has been set
+	char *base;			// first address of the arena
+	size_t trimThreshold;		// a free top block larger than this is trimmed
+	bool trimmed;			// the top was trimmed since the heap last grew
+	unsigned frees;			// block frees, to pace the scavenger
+#ifndef TLSF
+	size_t scavengeSize;		// the scavenger resumes at tree key (scavengeSize, scavengeAddr)
+	char *scavengeAddr;
+#endif
+	char *quick[QUICK_CLASSES];	// quick list of each block size, linked through the payload
+	uint8_t quickCount[QUICK_CLASSES];	// blocks on each quick list
+	uint64_t quickMap;		// bit i set if quick[i] is non-empty
+	size_t extends;			// extend_heap calls since the arena was created
+	size_t extendBytes;		// bytes those calls added to the heap
+#ifdef TLSF
+	uint64_t flBitmap;		// bit fl set if any second-level list of fl is non-empty
+	uint64_t slBitmap[FL_COUNT];	// bit sl set if list (fl, sl) is non-empty
+#else
+	uint64_t classMap;		// bit cls set if freeLists[cls] is non-empty
+#endif
+#ifdef THREAD_SAFE
+	pthread_mutex_t lock;		// guards all of the above
+	char *remote;			// lock-free stack of blocks freed by other threads
+	unsigned remotePushes;		// pushes onto remote since it was last drained
+#endif
+	int index;			// memlib arena backing this heap
+} arena_t;
+
+static arena_t arenas[NUM_ARENAS];
+#ifdef THREAD_SAFE
+static __thread arena_t *arena;		// arena the heap functions operate on (its lock held)
+static __thread arena_t *home;		// arena this thread allocates from
+static unsigned long heap_generation;	// bumped by mm_init; stale thread caches are dropped
+bool mm_remote_free = true;		// hand cross-thread frees to the owner's remote stack
+#else
+static arena_t *arena = &arenas[0];	// arena the heap functions operate on
+#endif
 static size_t DW_SIZE = 16;     	// double word size is equal 16
 static size_t W_SIZE = 8;       	// each word size is equal to 8
 static size_t CHUNKSIZE = (1<<12);	// chunk size = 4kb
+static size_t MAP_THRESHOLD = (1<<20);	// requests of 1 MB or more get a region of their own
+static size_t TRIM_THRESHOLD = (1<<17);	// initial trim threshold of an arena, 128 KB
+static size_t GROW_SHIFT = 6;		// the heap grows by at least 1/64 of its size
+static size_t GROW_MAX = (1<<18);	// but by no more than 256 KB beyond the request
 /* **** HELPER FUNCTIONS ************************* */
 
 /* rounds up to the nearest multiple of ALIGNMENT */
@@ -80,12 +228,52 @@ static size_t align(size_t x)
 static size_t GET (char *p)			// read word at address p
 {
     // printf("p: %p\n", p);
+#if defined(THREAD_SAFE)
+	return __atomic_load_n((size_t *)(p), __ATOMIC_RELAXED);	// owners read their header without the lock
+#elif defined(SPARSE_HEAP)
+	return mem_read(p, W_SIZE);		// the sparse heap is not addressable
+#else
 	return (*(size_t *)(p));
+#endif
 }
 
 static void PUT(char *p, size_t val)		// write word at address p
 {
+#if defined(THREAD_SAFE)
+	__atomic_store_n((size_t *)(p), val, __ATOMIC_RELAXED);
+#elif defined(SPARSE_HEAP)
+	mem_write(p, val, W_SIZE);
+#else
 	(*(size_t *)(p)) = val;
+#endif
+}
+
+static char *GET_PTR(char **p)			// read link at address p, which may also be outside the heap
+{
+#ifdef SPARSE_HEAP
+	return (char *)mem_read(p, W_SIZE);
+#else
+	return *p;
+#endif
+}
+
+static void PUT_PTR(char **p, char *val)	// write link at address p
+{
+#ifdef SPARSE_HEAP
+	mem_write(p, (uint64_t)val, W_SIZE);
+#else
+	*p = val;
+#endif
+}
+
+static size_t GET_FIELD(void *field)		// read word-sized field of a struct kept in the heap
+{
+	return GET((char *)field);
+}
+
+static void PUT_FIELD(void *field, size_t val)	// write word-sized field of a struct kept in the heap
+{
+	PUT((char *)field, val);
 }
 
 static size_t GET_SIZE(char *p)		// read size at address p
@@ -98,7 +286,7 @@ static char *HDRP(char *bp)			// get address of header with block ptr
 	return ((char *)(bp) - W_SIZE);
 }
 
-static char *FTRP(char *bp)			// get address of footer with block ptr
+static char *FTRP(char *bp)			// get address of footer with block ptr (free blocks only)
 {
 	return ((char *)(bp) + GET_SIZE(HDRP(bp)) - DW_SIZE);
 }
@@ -108,8 +296,12 @@ static char *NEXT_BLKP(char *bp)		// get address of next block using block ptr
 	return (char *)(bp) + GET_SIZE(HDRP(bp));
 }
 
-static char *PREV_BLKP(char *bp)		// get address of previous blk using block ptr
+static uint64_t GET_PREV_MINI(char *p);
+
+static char *PREV_BLKP(char *bp)		// get address of previous blk using block ptr (previous must be free)
 {
+	if (GET_PREV_MINI(HDRP(bp)))		// mini blocks have no footer, but their size is fixed
+		return (char *)(bp) - DW_SIZE;
 	return (char *)(bp) - GET_SIZE((char *)bp - DW_SIZE);
 }
 
@@ -118,6 +310,41 @@ static uint64_t GET_ALLOC(char *p)		// read allocated field from address p
 	return (GET(p) & 0x1);
 }
 
+static uint64_t GET_PREV_ALLOC(char *p)	// read previous-block-allocated field from address p
+{
+	return (GET(p) & 0x2);
+}
+
+static void SET_PREV_ALLOC(char *p, bool alloc)	// set or clear previous-block-allocated field at address p
+{
+	PUT(p, alloc ? (GET(p) | 0x2) : (GET(p) & ~(size_t)0x2));
+}
+
+static uint64_t GET_PREV_MINI(char *p)		// read previous-block-is-mini field from address p
+{
+	return (GET(p) & 0x4);
+}
+
+static void SET_PREV_MINI(char *p, bool mini)	// set or clear previous-block-is-mini field at address p
+{
+	PUT(p, mini ? (GET(p) | 0x4) : (GET(p) & ~(size_t)0x4));
+}
+
+static uint64_t GET_ZEROED(char *p)		// read free-block-reads-as-zero field from address p
+{
+	return (GET(p) & 0x8);
+}
+
+static void SET_ZEROED(char *p)			// mark the free block whose header is at p as reading zero
+{
+	PUT(p, GET(p) | 0x8);
+}
+
+static size_t GET_PREV_BITS(char *p)		// read both previous-block fields from address p
+{
+	return (GET(p) & 0x6);
+}
+
 static char **NEXT_PTR(char *bp)
 {
 	return ((char **)(bp+W_SIZE));		// point to next ptr of free list
@@ -128,43 +355,367 @@ static char **PREV_PTR(char *bp)
 	return ((char **)(bp));			// point to previous ptr of free list
 }
 
+static char **MINI_NEXT(char *bp)
+{
+	return ((char **)(bp));			// point to the link in the first payload word (thread cache bins)
+}
+
+#ifdef TLSF
+static int size_class(size_t size)		// get index fl * SL_COUNT + sl of the list holding blocks of size
+{
+	if (size < SMALL_BLOCK)
+		return (int)(size / DW_SIZE);		// first level 0: one class per 16 bytes
+
+	int log2 = 63 - __builtin_clzl(size);		// size lies in [2^log2, 2^(log2+1))
+	int fl = log2 - (SL_LOG2 + 4) + 1;
+	int sl = (int)(size >> (log2 - SL_LOG2)) - SL_COUNT;
+	if (fl >= FL_COUNT)
+		return NUM_CLASSES - 1;
+	return fl * SL_COUNT + sl;
+}
+
+static void set_class_bit(int cls)		// mark list cls as non-empty
+{
+	arena->slBitmap[cls / SL_COUNT] |= (uint64_t)1 << (cls % SL_COUNT);
+	arena->flBitmap |= (uint64_t)1 << (cls / SL_COUNT);
+}
+
+static void clear_class_bit(int cls)		// mark list cls as empty
+{
+	arena->slBitmap[cls / SL_COUNT] &= ~((uint64_t)1 << (cls % SL_COUNT));
+	if (arena->slBitmap[cls / SL_COUNT] == 0)
+		arena->flBitmap &= ~((uint64_t)1 << (cls / SL_COUNT));
+}
+
+static int next_class(int cls)			// first non-empty list at or above cls, -1 if none
+{
+	int fl = cls / SL_COUNT;
+	uint64_t slMap = arena->slBitmap[fl] & (~(uint64_t)0 << (cls % SL_COUNT));
+	if (slMap == 0)
+	{
+		uint64_t flMap = arena->flBitmap & (~(uint64_t)0 << (fl + 1));	// otherwise the next non-empty first level
+		if (flMap == 0)
+			return -1;
+		fl = __builtin_ctzl(flMap);
+		slMap = arena->slBitmap[fl];
+	}
+	return fl * SL_COUNT + __builtin_ctzl(slMap);
+}
+#else
+static int size_class(size_t size)		// get index of the size class holding blocks of size
+{
+	if (size <= LINEAR_MAX)
+		return (int)(size / DW_SIZE) - 2;	// exact classes: 32, 48, ..., LINEAR_MAX
+
+	int log2 = 63 - __builtin_clzl(size - 1);	// size lies in (2^log2, 2^(log2+1)]
+	int cls = (LINEAR_MAX / DW_SIZE) - 1 + (log2 - 8);
+	return cls < NUM_CLASSES ? cls : NUM_CLASSES - 1;
+}
+
+static void set_class_bit(int cls)		// mark list cls as non-empty
+{
+	arena->classMap |= (uint64_t)1 << cls;
+}
+
+static void clear_class_bit(int cls)		// mark list cls as empty
+{
+	arena->classMap &= ~((uint64_t)1 << cls);
+}
+
+static int next_class(int cls)			// first non-empty list at or above cls, -1 if none
+{
+	uint64_t map = arena->classMap & (~(uint64_t)0 << cls);
+	return map ? __builtin_ctzl(map) : -1;
+}
+
+/*
+ * Top-down splay trees (Sleator and Tarjan), adapted from stree.c. A node
+ * is the free block itself, its left and right child overlay the list
+ * links, so nodes fit in 32-byte blocks and need no parent pointer. The
+ * root of class cls is freeLists[cls]. TREE_CLASS is keyed by (size,
+ * address); the address-ordered classes by address alone.
+ */
+static char **TREE_LEFT(char *bp)
+{
+	return ((char **)(bp));
+}
+
+static char **TREE_RIGHT(char *bp)
+{
+	return ((char **)(bp+W_SIZE));
+}
+
+static bool is_tree(int cls)			// class cls is kept in a splay tree
+{
+#ifdef ADDRESS_ORDER
+	return true;
+#else
+	return cls == TREE_CLASS;
+#endif
+}
+
+static int tree_cmp(int cls, size_t size, char *addr, char *bp)	// key (size, addr) against bp
+{
+	size_t bsize = cls == TREE_CLASS ? GET_SIZE(HDRP(bp)) : 0;
+	if (size != bsize)
+		return size < bsize ? -1 : 1;
+	return addr < bp ? -1 : addr > bp;
+}
+
+static char *tree_splay(int cls, size_t size, char *addr, char *t)	// the node nearest the key becomes the root
+{
+	char *side[2] = {NULL, NULL};			// roots of the left and right trees built on the way down
+	char *hold = (char *)side;			// their holder, left child = side[0]
+	char *l = hold, *r = hold;
+
+	if (!t)
+		return NULL;
+	for (;;)
+	{
+		int c = tree_cmp(cls, size, addr, t);
+		if (c < 0)
+		{
+			char *y = GET_PTR(TREE_LEFT(t));
+			if (!y)
+				break;
+			if (tree_cmp(cls, size, addr, y) < 0)	// zig-zig: rotate right
+			{
+				PUT_PTR(TREE_LEFT(t), GET_PTR(TREE_RIGHT(y)));
+				PUT_PTR(TREE_RIGHT(y), t);
+				t = y;
+				if (!GET_PTR(TREE_LEFT(t)))
+					break;
+			}
+			PUT_PTR(TREE_LEFT(r), t);			// link right
+			r = t;
+			t = GET_PTR(TREE_LEFT(t));
+		}
+		else if (c > 0)
+		{
+			char *y = GET_PTR(TREE_RIGHT(t));
+			if (!y)
+				break;
+			if (tree_cmp(cls, size, addr, y) > 0)	// zig-zig: rotate left
+			{
+				PUT_PTR(TREE_RIGHT(t), GET_PTR(TREE_LEFT(y)));
+				PUT_PTR(TREE_LEFT(y), t);
+				t = y;
+				if (!GET_PTR(TREE_RIGHT(t)))
+					break;
+			}
+			PUT_PTR(TREE_RIGHT(l), t);			// link left
+			l = t;
+			t = GET_PTR(TREE_RIGHT(t));
+		}
+		else
+			break;
+	}
+	PUT_PTR(TREE_RIGHT(l), GET_PTR(TREE_LEFT(t)));			// reassemble
+	PUT_PTR(TREE_LEFT(r), GET_PTR(TREE_RIGHT(t)));
+	PUT_PTR(TREE_LEFT(t), side[1]);
+	PUT_PTR(TREE_RIGHT(t), side[0]);
+	return t;
+}
+
+static size_t tree_size(int cls, char *bp)		// size part of the key of bp
+{
+	return cls == TREE_CLASS ? GET_SIZE(HDRP(bp)) : 0;
+}
+
+static void tree_insert(int cls, char *bp)
+{
+	char *t = tree_splay(cls, tree_size(cls, bp), bp, arena->freeLists[cls]);
+	if (!t)
+	{
+		PUT_PTR(TREE_LEFT(bp), NULL);
+		PUT_PTR(TREE_RIGHT(bp), NULL);
+	}
+	else if (tree_cmp(cls, tree_size(cls, bp), bp, t) < 0)
+	{
+		PUT_PTR(TREE_LEFT(bp), GET_PTR(TREE_LEFT(t)));
+		PUT_PTR(TREE_RIGHT(bp), t);
+		PUT_PTR(TREE_LEFT(t), NULL);
+	}
+	else
+	{
+		PUT_PTR(TREE_RIGHT(bp), GET_PTR(TREE_RIGHT(t)));
+		PUT_PTR(TREE_LEFT(bp), t);
+		PUT_PTR(TREE_RIGHT(t), NULL);
+	}
+	arena->freeLists[cls] = bp;
+}
+
+static void tree_remove(int cls, char *bp)
+{
+	char *t = tree_splay(cls, tree_size(cls, bp), bp, arena->freeLists[cls]);	// bp is the root now
+	if (!GET_PTR(TREE_LEFT(t)))
+	{
+		arena->freeLists[cls] = GET_PTR(TREE_RIGHT(t));
+		return;
+	}
+	char *max = tree_splay(cls, tree_size(cls, bp), bp, GET_PTR(TREE_LEFT(t)));	// largest on the left, no right child
+	PUT_PTR(TREE_RIGHT(max), GET_PTR(TREE_RIGHT(t)));
+	arena->freeLists[cls] = max;
+}
+
+static char *tree_find(int cls, size_t size, char *addr)	// first block with key at or above (size, addr)
+{
+	char *t = tree_splay(cls, size, addr, arena->freeLists[cls]);
+	arena->freeLists[cls] = t;
+	if (!t || tree_cmp(cls, size, addr, t) <= 0)
+		return t;
+	for (t = GET_PTR(TREE_RIGHT(t)); t && GET_PTR(TREE_LEFT(t)); t = GET_PTR(TREE_LEFT(t)))
+		;
+	return t;
+}
+#endif
+
+/*
+ * Walk the free blocks of class cls, in key order in a tree: the first
+ * one that may hold size bytes, then the rest.
+ */
+static char *free_first(int cls, size_t size)
+{
+#ifndef TLSF
+	if (is_tree(cls))
+		return tree_find(cls, cls == TREE_CLASS ? size : 0, NULL);
+#endif
+	return arena->freeLists[cls];
+}
+
+static char *free_next(int cls, char *bp)
+{
+#ifndef TLSF
+	if (is_tree(cls))
+		return tree_find(cls, tree_size(cls, bp), bp + 1);
+#endif
+	return GET_PTR(NEXT_PTR(bp));
+}
+
+/*
+ * Mini blocks are 16 bytes: a header and one payload word. Free ones are
+ * kept on their own doubly-linked list, so a coalesce takes one out in
+ * constant time. Both links share the payload word as 32-bit offsets from
+ * the arena base in units of 16 bytes, which reach the first MINI_REACH
+ * (64 GB) bytes of the arena, so extend_heap never grows a heap past
+ * that even where the arena spans more. Bit 2 of the following header
+ * tells PREV_BLKP that the block in front has no footer.
+ */
+#define MINI_REACH ((1ULL << 32) * 16)
+
+static char *mini_ptr(uint64_t ref)		// mini block at offset ref, NULL for 0
+{
+	return ref ? arena->base + ref * DW_SIZE : NULL;
+}
+
+static uint64_t mini_ref(char *bp)		// offset of mini block bp, 0 for NULL
+{
+	return bp ? (uint64_t)(bp - arena->base) / DW_SIZE : 0;
+}
+
+static char *mini_next(char *bp)		// next block on the mini list
+{
+	return mini_ptr(GET(bp) & 0xffffffff);
+}
+
+static void mini_set(char *bp, char *prev, char *next)	// link bp between prev and next
+{
+	PUT(bp, mini_ref(prev) << 32 | mini_ref(next));
+}
+
+static void mini_add(char *bp)
+{
+	char *head = arena->miniList;
+	mini_set(bp, NULL, head);			// push onto the mini list
+	if (head)
+		mini_set(head, bp, mini_next(head));
+	arena->miniList = bp;
+}
+
+static void mini_delete(char *bp)
+{
+	char *prev = mini_ptr(GET(bp) >> 32);
+	char *next = mini_next(bp);
+	if (prev)
+		mini_set(prev, mini_ptr(GET(prev) >> 32), next);
+	else
+		arena->miniList = next;
+	if (next)
+		mini_set(next, prev, mini_next(next));
+}
+
 static void free_add(char *bp)
 {
-    dbg_printf("free_add: %p freePtr: %p\n", bp, freePtr);
+	if (GET_SIZE(HDRP(bp)) == DW_SIZE)
+	{
+		mini_add(bp);
+		return;
+	}
+	int cls = size_class(GET_SIZE(HDRP(bp)));
+    dbg_printf("free_add: %p class: %d head: %p\n", bp, cls, arena->freeLists[cls]);
+#ifndef TLSF
+	if (is_tree(cls))
+	{
+		tree_insert(cls, bp);
+		set_class_bit(cls);
+		mm_checkheap(0);
+		return;
+	}
+#endif
 	char **nextPtr = NEXT_PTR(bp);		// gets next ptr of new free
-	*nextPtr = freePtr;			// sets next ptr to the current free blk
+	PUT_PTR(nextPtr, arena->freeLists[cls]);		// sets next ptr to the current head of its class
 	
-	if(freePtr)				
+	if(arena->freeLists[cls])				
+	{
+		char **prevFPtr = PREV_PTR(arena->freeLists[cls]);	// gets previous pointer of current head
+		PUT_PTR(prevFPtr, bp);				// sets previous ptr to the new free
+	}
+	else
 	{
-		char **prevFPtr = PREV_PTR(freePtr);	// gets previous pointer of current free blk
-		*prevFPtr = bp;				// sets previous ptr to the new free
+		set_class_bit(cls);			// list was empty until now
 	}
 	
 	char **prevPtr = PREV_PTR(bp);			// get previous ptr of new free
-	*prevPtr = NULL;				// set it to NULL
-	freePtr = bp;					// set current block to new free
-    dbg_printf("freePtr: %p\n", freePtr);
+	PUT_PTR(prevPtr, NULL);				// set it to NULL
+	arena->freeLists[cls] = bp;				// new free becomes head of its class
     mm_checkheap(0);
 }
 
 static void free_delete(char *ptr)
 {
     dbg_printf("deleting: %p\n", ptr);
-	if (*PREV_PTR(ptr) == NULL)				// if first in list
+	if (GET_SIZE(HDRP(ptr)) == DW_SIZE)
+	{
+		mini_delete(ptr);
+		return;
+	}
+#ifndef TLSF
+	int cls = size_class(GET_SIZE(HDRP(ptr)));
+	if (is_tree(cls))
 	{
-		freePtr = *NEXT_PTR(ptr);			// set current free to next address of deleted block
-        dbg_printf("freePtr: %p\n", ptr);	
+		tree_remove(cls, ptr);
+		if (arena->freeLists[cls] == NULL)
+			clear_class_bit(cls);
+		return;
+	}
+#endif
+	if (GET_PTR(PREV_PTR(ptr)) == NULL)				// if first in list
+	{
+		int cls = size_class(GET_SIZE(HDRP(ptr)));
+		arena->freeLists[cls] = GET_PTR(NEXT_PTR(ptr));		// set head of its class to next address of deleted block
+		if (arena->freeLists[cls] == NULL)
+			clear_class_bit(cls);			// deleted the last block of the class
 	}
 	else
 	{
-		char **nextPtr = NEXT_PTR(*PREV_PTR(ptr));	// get next pointer of previous block of deleted ptr
-		*nextPtr = *NEXT_PTR(ptr);			// set to next ptr of deleted block
+		char **nextPtr = NEXT_PTR(GET_PTR(PREV_PTR(ptr)));	// get next pointer of previous block of deleted ptr
+		PUT_PTR(nextPtr, GET_PTR(NEXT_PTR(ptr)));			// set to next ptr of deleted block
 	}
 	
-	if (*NEXT_PTR(ptr))					
+	if (GET_PTR(NEXT_PTR(ptr)))					
 	{
-		char **prevPtr = PREV_PTR(*NEXT_PTR(ptr));	// get previous ptr of next block of deleted ptr
-		*prevPtr = *PREV_PTR(ptr);			// set to previous ptr of deleted block
+		char **prevPtr = PREV_PTR(GET_PTR(NEXT_PTR(ptr)));	// get previous ptr of next block of deleted ptr
+		PUT_PTR(prevPtr, GET_PTR(PREV_PTR(ptr)));			// set to previous ptr of deleted block
 	}	
 }
 
@@ -173,31 +724,114 @@ static int MAX (size_t x, size_t y)
     return (x > y) ? x : y;             // if x is greater than y, returns x. else return y
 }
 
+#ifdef TLSF
+static void *search_fit(size_t aligned_size)
+{
+    if (aligned_size == DW_SIZE && arena->miniList)	// exact fit for a mini request
+        return arena->miniList;
+
+    size_t target = aligned_size;
+    if (aligned_size >= SMALL_BLOCK)		// round up to the next class boundary so that
+    {						// every block of the class found is large enough
+        int log2 = 63 - __builtin_clzl(aligned_size);
+        target += ((size_t)1 << (log2 - SL_LOG2)) - 1;
+    }
+    int cls = next_class(size_class(target));
+    return cls < 0 ? NULL : arena->freeLists[cls];	// head of the list always fits
+}
+#else
+/*
+ * Best fit among the large blocks. When that block is zeroed, so its pages
+ * may have been released and would fault back in, the next few tree keys
+ * are tried for a resident block at most a quarter larger.
+ */
+#define RESIDENT_LOOKS 4
+
+static char *tree_fit(size_t aligned_size)
+{
+    char *best = free_first(TREE_CLASS, aligned_size);
+    if (best == NULL || !GET_ZEROED(HDRP(best)))
+        return best;
+    size_t limit = GET_SIZE(HDRP(best)) + GET_SIZE(HDRP(best)) / 4;
+    char *bp = best;
+    for (int i = 0; i < RESIDENT_LOOKS; i++)
+    {
+        if ((bp = free_next(TREE_CLASS, bp)) == NULL || GET_SIZE(HDRP(bp)) > limit)
+            break;
+        if (!GET_ZEROED(HDRP(bp)))
+            return bp;
+    }
+    return best;
+}
+
 static void *search_fit(size_t aligned_size)
 {
     char *bp;
+    int cls;
 
-    for (bp = freePtr; bp; bp = *NEXT_PTR(bp))		// loop through free list to find a fit
+    if (aligned_size == DW_SIZE)		// exact fit for a mini request, else the smallest class
+    {
+        if (arena->miniList)
+            return arena->miniList;
+        aligned_size = 2 * DW_SIZE;
+    }
+    for (cls = next_class(size_class(aligned_size)); cls >= 0;	// only the matching class and those above it,
+         cls = cls + 1 < NUM_CLASSES ? next_class(cls + 1) : -1)	// skipping empty ones
     {
-        if (aligned_size <= GET_SIZE(HDRP(bp)))		// if fit found return a pointer to that block
+        char *zeroed = NULL;			// first fit whose pages may have to fault in
+        if (cls == TREE_CLASS)			// best fit among the large blocks, resident if one is close
+            return tree_fit(aligned_size);
+        for (bp = free_first(cls, aligned_size); bp; bp = free_next(cls, bp))	// first fit within the class
         {
-            return bp;
+            if (aligned_size <= GET_SIZE(HDRP(bp)))		// if fit found return a pointer to that block
+            {
+                if (!GET_ZEROED(HDRP(bp)))
+                    return bp;
+                if (zeroed == NULL)
+                    zeroed = bp;
+            }
         }
+        if (zeroed)				// no resident fit in the class
+            return zeroed;
     }
     return NULL;									// otherwise return NULL
 }
-
+#endif
 
 static size_t PACK(size_t size, size_t alloc)
 {
     return  ((size) | (alloc));
 }
 
+/*
+ * Zeroed free blocks. Bit 3 of a free block's header records that its
+ * interior, everything between its links and its footer, reads as zero:
+ * the block is fresh from memlib or was handed back by the scavenger, and
+ * its pages may not even be resident. Splitting such a block, placing in
+ * it or trimming it leaves the mark on what is left, and two zeroed
+ * neighbours merge into a zeroed block once the four words between their
+ * interiors are cleared. A freed block never has the mark, and mini
+ * blocks have no interior to mark. calloc only clears what a zeroed block
+ * does not already hold as zero.
+ */
+static size_t zero_join(char *lo, char *hi)	// 0x8 if free neighbours lo and hi merge into a zeroed block
+{
+	if (!GET_ZEROED(HDRP(lo)) || !GET_ZEROED(HDRP(hi)))
+		return 0;
+	memset(hi - DW_SIZE, 0, 2 * DW_SIZE);	// footer of lo, header and links of hi
+	return 0x8;
+}
+
+/*
+ * Allocated blocks carry only a header; free blocks also carry a footer.
+ * Bit 1 of every header records whether the previous block is allocated,
+ * so the footer of the previous block is only read when it exists.
+ */
 static void *coalesce(void *bp)
 {
-	size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+	size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
 	size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-    dbg_printf("prev block: %p and prev_alloc:%lu next block: %p and next_alloc: %lu\n", PREV_BLKP(bp), prev_alloc, NEXT_BLKP(bp), next_alloc);
+    dbg_printf("prev_alloc:%lu next block: %p and next_alloc: %lu\n", prev_alloc, NEXT_BLKP(bp), next_alloc);
 	size_t size = GET_SIZE(HDRP(bp));
 	
 	if (prev_alloc && next_alloc) {			// Case 1: if adjacent blocks are both allocated,
@@ -209,7 +843,8 @@ static void *coalesce(void *bp)
 	{										
 		size+= GET_SIZE(HDRP(NEXT_BLKP(bp))); 	// add size of free blk header to size
         free_delete(NEXT_BLKP(bp));             // delete previous block from free list
-		PUT(HDRP(bp), (size|0));		// write size to blk ptr header and footer
+		size_t zero = zero_join(bp, NEXT_BLKP(bp));
+		PUT(HDRP(bp), PACK(size, GET_PREV_BITS(HDRP(bp)) | zero));	// write size to blk ptr header and footer
 		PUT(FTRP(bp), (size|0));		
 	}
 	
@@ -218,50 +853,70 @@ static void *coalesce(void *bp)
 		size+=GET_SIZE(HDRP(PREV_BLKP(bp)));	// add header of free block size to size
         dbg_printf("new size: %lu\n", size);
         dbg_printf("prev blkp: %p\n", PREV_BLKP(bp));
-        free_delete(PREV_BLKP(bp));             // delete previous block from free list
+        char *prev = PREV_BLKP(bp);             // found before the join clears the header of bp
+        free_delete(prev);                      // delete previous block from free list
+		size_t zero = zero_join(prev, bp);
+		bp = prev;				// set blk ptr to the free blk
+		PUT(HDRP(bp), PACK(size, GET_PREV_BITS(HDRP(bp)) | zero));	// write size to free blk's header
 		PUT(FTRP(bp), (size|0));		// write size to footer
-		PUT(HDRP(PREV_BLKP(bp)), (size|0));	// write size to free blk's header
-		bp = PREV_BLKP(bp);			// set blk ptr to the free blk
 	}
 	
 	else {										// Case 4: If both blocks free
-		size+=GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));	// add size of previous blk header and next blk footer to size
-        free_delete(PREV_BLKP(bp));                         // delete previous block from free list
+		size+=GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));	// add size of previous and next blk to size
+        char *prev = PREV_BLKP(bp);                         // found before the join clears the header of bp
+        free_delete(prev);                                  // delete previous block from free list
         free_delete(NEXT_BLKP(bp));                         // delete next block from free list
-		PUT(HDRP(PREV_BLKP(bp)), (size|0));					// write size to previous blk header
-		PUT(FTRP(NEXT_BLKP(bp)), (size|0));					// write size to next blk footer
-		bp = PREV_BLKP(bp);							// set blk ptr to previous blk
+		size_t zero = zero_join(bp, NEXT_BLKP(bp)) ? zero_join(prev, bp) : 0;
+		bp = prev;								// set blk ptr to previous blk
+		PUT(HDRP(bp), PACK(size, GET_PREV_BITS(HDRP(bp)) | zero));			// write size to previous blk header
+		PUT(FTRP(bp), (size|0));						// write size to next blk footer
 	}
+	SET_PREV_MINI(HDRP(NEXT_BLKP(bp)), false);	// a merged block is never a mini block
     free_add(bp);               // add blk ptr to free list
 	return bp;					// return the blk ptr
 }
 
-static void place(void *bp, size_t aligned_size)
+/*
+ * Marks the first aligned_size bytes of the csize-byte span at bp as an
+ * allocated block and returns any remainder of 16 bytes or more to the
+ * free lists. The span must not be on a free list. zero is 0x8 if the
+ * span was a zeroed free block, whose remainder stays zeroed.
+ */
+static void split_block(char *bp, size_t csize, size_t aligned_size, size_t zero)
 {
-    size_t csize = GET_SIZE(HDRP(bp));
-
+    size_t prevBits = GET_PREV_BITS(HDRP(bp));
     size_t remSize = csize - aligned_size; 
     dbg_printf("cSize: %lu aligned_size: %lu remSize: %lu\n", csize, aligned_size, remSize);
-    if (remSize >= (2 * DW_SIZE)) 		// splitting the block
+    if (remSize >= DW_SIZE) 		// splitting the block, the remainder may be a mini block
     {
-        PUT(HDRP(bp), PACK(aligned_size, 1));		// takes in size and OR with 1, and store 
-        PUT(FTRP(bp), PACK(aligned_size, 1));
-        free_delete(bp);                // delete the free block at address bp
+        PUT(HDRP(bp), PACK(aligned_size, prevBits | 1));	// takes in size and OR with 1, and store; no footer
         bp = NEXT_BLKP(bp);				// allocate the first half and freeing the second half
 
-        PUT(HDRP(bp), PACK(remSize, 0));		// put remSize in header and footer
-        PUT(FTRP(bp), PACK(remSize, 0));
+        PUT(HDRP(bp), PACK(remSize, 0x2 | (aligned_size == DW_SIZE ? 0x4 : 0)));	// put remSize in header and footer
+        if (remSize > DW_SIZE)
+        {
+            PUT(HDRP(bp), GET(HDRP(bp)) | zero);
+            PUT(FTRP(bp), PACK(remSize, 0));
+        }
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)), false);	// next block now follows the free remainder
+        SET_PREV_MINI(HDRP(NEXT_BLKP(bp)), remSize == DW_SIZE);
         coalesce(bp);
 
     }
     else
     {
-        PUT(HDRP(bp), PACK(csize, 1));			// otherwise put csize in header and footer
-        PUT(FTRP(bp), PACK(csize, 1));
-        free_delete(bp);                        // delete the free block at address bp
+        PUT(HDRP(bp), PACK(csize, prevBits | 1));	// otherwise put csize in header
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)), true);	// next block now follows an allocated one
+        SET_PREV_MINI(HDRP(NEXT_BLKP(bp)), csize == DW_SIZE);
     }
 }
 
+static void place(void *bp, size_t aligned_size)
+{
+    free_delete(bp);                    // unlink while the header still holds the class size
+    split_block(bp, GET_SIZE(HDRP(bp)), aligned_size, GET_ZEROED(HDRP(bp)));
+}
+
 /* END OF HELPER FUNCTIONS */
 /*****************************************************************************/
 /* Merges adjacent free blocks together */
@@ -273,16 +928,27 @@ static void *extend_heap(size_t words)
 {
 	char *bp;					// block pointer
 	size_t size;
+	size_t zero;
 	
 	if (words%2)					// if odd
 		size=(words+1)*W_SIZE;			// add 1 to make even and align to 4 byte word
 	else						// to maintain alignment
 		size=words*W_SIZE;				// otherwise just align to 4 byte word
     dbg_printf("extend heap called size: %lu\n", size);
-	if ((long)(bp=mem_sbrk(size)) == -1)		// if heap extension of size fails
+	zero = (char *)mem_arena_clean(arena->index) <= (char *)mem_arena_hi(arena->index) + 1 ? 0x8 : 0;	// never used before
+	if ((size_t)((char *)mem_arena_hi(arena->index) + 1 - arena->base) + size > MINI_REACH)
+		return NULL;				// beyond what the mini list can link
+	if ((long)(bp=mem_arena_sbrk(arena->index, size)) == -1)	// if heap extension of size fails
 		return NULL;				// :return NULL
+	arena->extends++;
+	arena->extendBytes += size;
+	if (arena->trimmed)				// growing back what was trimmed:
+	{						// trim less eagerly from now on
+		arena->trimThreshold *= 2;
+		arena->trimmed = false;
+	}
     dbg_printf("bp: %p size: %lu\n", (char *)bp, GET_SIZE(HDRP(bp)));
-	PUT(HDRP(bp), (size|0));			// else: write size to header of blk ptr
+	PUT(HDRP(bp), PACK(size, GET_PREV_BITS(HDRP(bp)) | zero));	// else: write size to header of blk ptr over the old epilogue
 	PUT(FTRP(bp), (size|0));			// 	 write size to footer of blk ptr
     dbg_printf("size of bp: %lu", GET_SIZE(HDRP(bp)));
 	PUT(HDRP(NEXT_BLKP(bp)), (0|1));		// write 1 to header of next blk to show allocation
@@ -292,74 +958,1183 @@ static void *extend_heap(size_t words)
 }
 
 /*
- * Initialize: returns false on error, true on success.
+ * Gives the top of the heap back to memlib when the free block bp ends
+ * at the epilogue and is larger than the arena's trim threshold. Half the
+ * threshold is kept so that the next requests do not extend right away.
+ * The threshold doubles whenever the heap has to grow again after a trim,
+ * so a heap that keeps growing and shrinking soon stops trimming.
  */
-
-bool mm_init(void)
+static void trim_heap(char *bp)
 {
- /* Create the initial empty heap */
-    if ((heap_listp = mem_sbrk(4*W_SIZE)) == (void *)-1)	
-        return -1;
-    PUT(heap_listp, 0); /* Alignment padding */
-    PUT(heap_listp + (1*W_SIZE), PACK(DW_SIZE, 1)); /* Prologue header */
-    PUT(heap_listp + (2*W_SIZE), PACK(DW_SIZE, 1)); /* Prologue footer */
-	    PUT(heap_listp + (3*W_SIZE), PACK(0, 1)); /* Epilogue header */
-	    heap_listp += (2*W_SIZE);
-	    // printf("heap_listp: %p\n", heap_listp);
-
-    freePtr = NULL;         // initialize free list to start of free memory in heap
-	 /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-	    if (extend_heap(CHUNKSIZE/W_SIZE) == NULL)
-        return 0;
-    mm_checkheap(0);
-    return 1;
-}
+    size_t size = GET_SIZE(HDRP(bp));
+    if (size <= arena->trimThreshold || GET_SIZE(HDRP(NEXT_BLKP(bp))) != 0)
+        return;
 
+    size_t keep = arena->trimThreshold / 2;
+    free_delete(bp);
+    PUT(HDRP(bp), PACK(keep, GET_PREV_BITS(HDRP(bp)) | GET_ZEROED(HDRP(bp))));
+    PUT(FTRP(bp), PACK(keep, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));           // new epilogue, after a free block
+    free_add(bp);
+    mem_arena_sbrk(arena->index, -(intptr_t)(size - keep));
+    arena->trimmed = true;
+}
 
 /*
- * malloc
+ * Scavenger. Every SCAVENGE_PERIOD frees, heap_free takes a few steps
+ * through the free blocks of SCAVENGE_MIN bytes or more and hands the
+ * whole pages inside each block back with mem_decommit. The header, links
+ * and footer stay resident. Those pages read as zero from now on, so the
+ * block is marked zeroed once the partial pages at either end are cleared
+ * too, and search_fit takes a resident fit of the same class first, or
+ * in TREE_CLASS a resident block close above the best fit.
+ *
+ * Such blocks all live in TREE_CLASS, so the scavenger keeps its place as
+ * a tree key and resumes after it on the next call: one call looks at no
+ * more than SCAVENGE_VISITS blocks and releases at most SCAVENGE_RELEASES
+ * of them, then starts over from the smallest once it runs off the end.
+ * The TLSF build has no ordered class to resume in and promises bounded
+ * frees, so it never scavenges.
  */
-void* malloc(size_t size)
-{
-    size_t aligned_size = size; 
-    size_t extend_size;
-    char *bp;
+#define SCAVENGE_PERIOD 1024
+#ifndef TLSF
+#define SCAVENGE_VISITS 16
+#define SCAVENGE_RELEASES 4
+static size_t SCAVENGE_MIN = (1<<16);	// smaller free blocks are left resident
+#endif
 
-    /* IMPLEMENT THIS */
-    if (size == 0) {    // returns NULL if size is 0
-        return NULL;
+static void scavenge(void)
+{
+#ifndef TLSF
+    int released = 0;
+    for (int visits = 0; visits < SCAVENGE_VISITS && released < SCAVENGE_RELEASES; visits++)
+    {
+        char *bp = tree_find(TREE_CLASS, arena->scavengeSize, arena->scavengeAddr);
+        if (bp == NULL)                             // past the largest block: start over next time
+        {
+            arena->scavengeSize = SCAVENGE_MIN;
+            arena->scavengeAddr = NULL;
+            return;
+        }
+        arena->scavengeSize = GET_SIZE(HDRP(bp));
+        arena->scavengeAddr = bp + 1;
+        if (GET_ZEROED(HDRP(bp)))
+            continue;
+        uintptr_t page = mem_pagesize();
+        char *lo = (char *)(((uintptr_t)bp + DW_SIZE + page - 1) & ~(page - 1));
+        char *hi = (char *)((uintptr_t)FTRP(bp) & ~(page - 1));
+        if (mem_decommit(bp + DW_SIZE, FTRP(bp) - (bp + DW_SIZE)) > 0)  // between the links and the footer
+        {
+            memset(bp + DW_SIZE, 0, lo - (bp + DW_SIZE));
+            memset(hi, 0, FTRP(bp) - hi);
+            SET_ZEROED(HDRP(bp));
+            released++;
+        }
     }
+#endif
+}
 
-    if (size <= DW_SIZE) {              // adjust block size and align the size
-        aligned_size = 2 * DW_SIZE;
-    }
-    else {
-        aligned_size = DW_SIZE + align(aligned_size);
-    }
+/*
+ * Bytes to extend the heap by for a block of need bytes. Small heaps grow
+ * by CHUNKSIZE; larger ones by 1/2^GROW_SHIFT of their size, rounded to
+ * CHUNKSIZE and capped at GROW_MAX, so a growing heap calls extend_heap a
+ * logarithmic number of times while the slack left at the top stays a
+ * small fraction of the heap. Once the heap spans a huge page and memlib
+ * backs it with huge pages, the heap grows in steps that end the break on
+ * a huge page boundary, so every huge page the heap touches is fully used.
+ */
+static size_t grow_size(size_t need)
+{
+    uintptr_t brk = (uintptr_t)mem_arena_hi(arena->index) + 1;
+    size_t heap = brk - (uintptr_t)arena->base;
+    size_t chunk = (heap >> GROW_SHIFT) & ~(CHUNKSIZE - 1);
 
-    dbg_printf("aligned size: %lu\n", aligned_size);
+    if (chunk < CHUNKSIZE)
+        chunk = CHUNKSIZE;
+    if (chunk > GROW_MAX)
+        chunk = GROW_MAX;
+    size_t size = need > chunk ? need : chunk;
+    if (!mem_hugepages())
+        return size;
 
-    if ((bp = search_fit(aligned_size)) != NULL)  {		// check if there is a fit
-        dbg_printf("bp size: %lu\n", GET_SIZE(HDRP(bp)));
-        place(bp, aligned_size);
-        mm_checkheap(0);
-        dbg_printf("alloc done for bp: %p\n", bp);
-        return bp;
-    }
+    size_t huge = mem_hugepagesize();
+    if (heap < huge)                                // small heaps keep the small steps
+        return size;
+    return ((brk + size + huge - 1) & ~(uintptr_t)(huge - 1)) - brk;
+}
 
+/*
+ * Size of the free block ending at the break, 0 if the last block is
+ * allocated. extend_heap coalesces the new space with it, so a request
+ * only needs the heap to grow by the deficit.
+ */
+static size_t tail_free(void)
+{
+    char *epilogue = (char *)mem_arena_hi(arena->index) + 1 - W_SIZE;
 
-    extend_size = aligned_size > CHUNKSIZE ? aligned_size : CHUNKSIZE;			// otherwise heap must be extended
-    dbg_printf("aligned_size: %lu extend_size: %lu\n", aligned_size, extend_size);
-    if ((bp = extend_heap(extend_size/W_SIZE)) == NULL) {				// extend heap
+    if (GET_PREV_ALLOC(epilogue))
+        return 0;
+    if (GET_PREV_MINI(epilogue))
+        return DW_SIZE;
+    return GET_SIZE(epilogue - W_SIZE);             // footer of the free block
+}
+
+/*
+ * Releases block bp to the heap: clears its allocated bit, writes the
+ * footer, tells the next block and coalesces.
+ */
+static void block_free(char *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    PUT(HDRP(bp), PACK(size, GET_PREV_BITS(HDRP(bp))));
+    if (size > DW_SIZE)                                 // mini blocks have no footer
+        PUT(FTRP(bp), PACK(size, 0));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)), false);       // next block now follows a free one
+    trim_heap(coalesce(bp));
+}
+
+/*
+ * Quick lists defer coalescing. A freed block of QUICK_MAX bytes or less
+ * is pushed onto the list of its exact size and stays marked allocated,
+ * so no footer is written, the next block is not touched and nothing
+ * coalesces with it. A request of the same block size pops it straight
+ * back. A list reaching QUICK_LIMIT blocks is released to the heap in one
+ * pass, and so are all of them when a request finds no free fit, before
+ * the heap is extended. The TLSF build frees straight to the heap.
+ */
+static void quick_release(int i)                    // empty quick list i into the heap
+{
+    char *q = arena->quick[i];
+    arena->quick[i] = NULL;                         // detached first, the heap checker may run
+    arena->quickCount[i] = 0;
+    arena->quickMap &= ~((uint64_t)1 << i);
+    while (q)
+    {
+        char *next = GET_PTR((char **)q);
+        block_free(q);
+        q = next;
+    }
+}
+
+static bool quick_push(char *bp, size_t size)       // size is the block size of bp
+{
+    if (size > QUICK_MAX)
+        return false;
+
+    int i = (int)(size / DW_SIZE);
+    if (arena->quickCount[i] == QUICK_LIMIT)        // full: release the whole list
+        quick_release(i);
+    PUT_PTR((char **)bp, arena->quick[i]);
+    arena->quick[i] = bp;
+    arena->quickCount[i]++;
+    arena->quickMap |= (uint64_t)1 << i;
+    return true;
+}
+
+static char *quick_pop(size_t aligned_size)
+{
+    if (aligned_size > QUICK_MAX)
+        return NULL;
+
+    int i = (int)(aligned_size / DW_SIZE);
+    char *bp = arena->quick[i];
+    if (bp == NULL)
+        return NULL;
+    arena->quick[i] = GET_PTR((char **)bp);
+    if (--arena->quickCount[i] == 0)
+        arena->quickMap &= ~((uint64_t)1 << i);
+    return bp;
+}
+
+static bool quick_flush(void)                       // release every quick list, false if all were empty
+{
+    if (arena->quickMap == 0)
+        return false;
+    while (arena->quickMap)
+        quick_release(__builtin_ctzl(arena->quickMap));
+    return true;
+}
+
+/*
+ * Converts a request of size payload bytes into an aligned block size
+ */
+static size_t adjust_size(size_t size)
+{
+    if (size <= W_SIZE) {               // adjust block size and align the size
+        return DW_SIZE;                 // mini block: header and one payload word
+    }
+    else if (size <= DW_SIZE + W_SIZE) {
+        return 2 * DW_SIZE;             // smallest block that can hold a free block's links and footer
+    }
+    return align(size + W_SIZE);        // payload plus header, no footer
+}
+
+/*
+ * Aligned placement. A free block can hold an aligned_size block whose
+ * payload is aligned to a power of two larger than ALIGNMENT when the
+ * block still fits once its payload is moved up to the boundary. Both
+ * are multiples of 16, so the leading bytes always form a block of their
+ * own, which goes back on the free lists instead of being wasted.
+ */
+static size_t align_pad(char *bp, size_t alignment)	// bytes from bp to the next alignment boundary
+{
+    return -(uintptr_t)bp & (alignment - 1);
+}
+
+static char *search_aligned(size_t alignment, size_t aligned_size)	// a free block that fits, or NULL
+{
+#ifdef TLSF
+    return search_fit(aligned_size + alignment - DW_SIZE);	// fits whatever the padding, in one lookup
+#else
+    for (int cls = next_class(size_class(aligned_size)); cls >= 0;
+         cls = cls + 1 < NUM_CLASSES ? next_class(cls + 1) : -1)
+    {
+        for (char *bp = free_first(cls, aligned_size); bp; bp = free_next(cls, bp))
+        {
+            if (align_pad(bp, alignment) + aligned_size <= GET_SIZE(HDRP(bp)))
+                return bp;
+        }
+    }
+    return NULL;
+#endif
+}
+
+static char *place_aligned(char *bp, size_t pad, size_t aligned_size)	// allocate at bp + pad
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t zero = GET_ZEROED(HDRP(bp));
+
+    free_delete(bp);
+    if (pad > 0)				// free the bytes in front of the boundary
+    {
+        PUT(HDRP(bp), PACK(pad, GET_PREV_BITS(HDRP(bp)) | (pad > DW_SIZE ? zero : 0)));
+        if (pad > DW_SIZE)
+            PUT(FTRP(bp), PACK(pad, 0));
+        PUT(HDRP(bp + pad), PACK(csize - pad, pad == DW_SIZE ? 0x4 : 0));
+        free_add(bp);
+        bp += pad;
+        csize -= pad;
+    }
+    split_block(bp, csize, aligned_size, zero);
+    return bp;
+}
+
+/*
+ * Slab runs. Requests of up to SLAB_MAX bytes are served from runs: heap
+ * blocks of RUN_SIZE bytes whose payload starts on a RUN_SIZE boundary, so
+ * that runs pack back to back; the last word of the page holds the header
+ * of the following block. The rest of the page is split into equal slots
+ * of one 16-byte class. Slots carry no header. A pointer is known to be a
+ * slot when the arena's run map has the bit of its page set, and its run
+ * is found by rounding down to RUN_SIZE. Free slots are tracked in the
+ * run's bitmap and found with count-trailing-zeros. A run whose slots are
+ * all free goes straight back to the heap, where it coalesces like any
+ * other block. The TLSF build carves no runs.
+ */
+static size_t RUN_BLOCK = RUN_SIZE;		// heap block holding a run, header included
+
+static arena_t *arena_of(const void *bp)	// arena whose address range holds bp
+{
+#if NUM_ARENAS > 1
+    return &arenas[mem_arena_of(bp)];
+#else
+    return &arenas[0];
+#endif
+}
+
+static bool is_slab(const void *bp)
+{
+    arena_t *a = arena_of(bp);
+    size_t page = ((const char *)bp - a->base) / RUN_SIZE;
+    return page < a->runMapEnd && (a->runMap[page / 64] >> (page % 64)) & 1;
+}
+
+static void set_run_bit(run_t *run, bool used)	// mark or unmark the page of run in the run map
+{
+    size_t page = ((char *)run - arena->base) / RUN_SIZE;
+    if (used)
+    {
+        arena->runMap[page / 64] |= 1ULL << (page % 64);
+        if (page >= arena->runMapEnd)
+            arena->runMapEnd = page + 1;
+    }
+    else
+        arena->runMap[page / 64] &= ~(1ULL << (page % 64));
+}
+
+static run_t *run_of(const void *bp)		// run holding slab slot bp
+{
+    return (run_t *)((uintptr_t)bp & ~(uintptr_t)(RUN_SIZE - 1));
+}
+
+static unsigned run_slots(size_t size)		// slots in a run of the given slot size
+{
+    return (RUN_SIZE - RUN_HDR - W_SIZE) / size;
+}
+
+static void run_link(run_t **list, run_t *run)	// push run onto a partial list
+{
+    PUT_FIELD(&run->prev, 0);
+    PUT_FIELD(&run->next, (size_t)*list);
+    if (*list)
+        PUT_FIELD(&(*list)->prev, (size_t)run);
+    *list = run;
+}
+
+static void run_unlink(run_t **list, run_t *run)
+{
+    run_t *prev = (run_t *)GET_FIELD(&run->prev);
+    run_t *next = (run_t *)GET_FIELD(&run->next);
+    if (prev)
+        PUT_FIELD(&prev->next, (size_t)next);
+    else
+        *list = next;
+    if (next)
+        PUT_FIELD(&next->prev, (size_t)prev);
+}
+
+static run_t *run_new(size_t size)		// an empty run of the given slot size
+{
+#ifdef TLSF
+    return NULL;				// an aligned carve per run breaks the TLSF bound, use ordinary blocks
+#endif
+    char *bp = search_aligned(RUN_SIZE, RUN_BLOCK);
+    if (bp == NULL && quick_flush())
+        bp = search_aligned(RUN_SIZE, RUN_BLOCK);
+    if (bp == NULL && (bp = extend_heap(grow_size(2 * RUN_SIZE) / W_SIZE)) == NULL)
+        return NULL;
+
+    size_t pad = align_pad(bp, RUN_SIZE);
+    if ((size_t)((bp + pad) - arena->base) / RUN_SIZE >= RUN_MAP_WORDS * 64)
+        return NULL;				// beyond the run map, use ordinary blocks
+
+    bp = place_aligned(bp, pad, RUN_BLOCK);
+
+    run_t *run = (run_t *)bp;
+    unsigned n = run_slots(size);
+    PUT_FIELD(&run->size, size);
+    PUT_FIELD(&run->nfree, n);
+    for (int w = 0; w < RUN_WORDS; w++, n = n > 64 ? n - 64 : 0)
+        PUT_FIELD(&run->bitmap[w], n >= 64 ? ~0ULL : (1ULL << n) - 1);
+    set_run_bit(run, true);
+    return run;
+}
+
+static void heap_free(void *ptr);
+static void *heap_malloc(size_t size);
+
+static void *slab_malloc(size_t size)
+{
+    int cls = (int)((size + 15) / 16) - 1;
+    run_t *run = arena->runs[cls];
+
+    if (run == NULL)
+    {
+        if ((run = run_new((cls + 1) * 16)) == NULL)
+            return NULL;
+        run_link(&arena->runs[cls], run);
+    }
+    int w = 0;
+    uint64_t map;
+    while ((map = GET_FIELD(&run->bitmap[w])) == 0)
+        w++;
+    int i = __builtin_ctzll(map);
+    PUT_FIELD(&run->bitmap[w], map & (map - 1));	// clear the lowest set bit
+    size_t nfree = GET_FIELD(&run->nfree) - 1;
+    PUT_FIELD(&run->nfree, nfree);
+    if (nfree == 0)					// full: drop it from the partial list
+        run_unlink(&arena->runs[cls], run);
+    return (char *)run + RUN_HDR + (size_t)(w * 64 + i) * GET_FIELD(&run->size);
+}
+
+static void slab_free(char *bp)
+{
+    run_t *run = run_of(bp);
+    size_t size = GET_FIELD(&run->size);
+    int cls = size / 16 - 1;
+    unsigned i = (bp - ((char *)run + RUN_HDR)) / size;
+
+    PUT_FIELD(&run->bitmap[i / 64], GET_FIELD(&run->bitmap[i / 64]) | 1ULL << (i % 64));
+    size_t nfree = GET_FIELD(&run->nfree) + 1;
+    PUT_FIELD(&run->nfree, nfree);
+    if (nfree == 1)					// was full: back on the partial list
+        run_link(&arena->runs[cls], run);
+    else if (nfree == run_slots(size))
+    {							// empty: return the page to the heap
+        run_unlink(&arena->runs[cls], run);
+        set_run_bit(run, false);
+        heap_free(run);
+    }
+}
+
+/*
+ * Mapped blocks. Requests of MAP_THRESHOLD bytes or more are given a
+ * region of their own from mem_map rather than growing an arena, so
+ * freeing them hands the memory straight back. The payload starts
+ * DW_SIZE bytes into the region, after a header holding the region size
+ * marked allocated. A pointer is known to be mapped because it lies
+ * outside every arena, not by its header, so no lock is needed to free one.
+ */
+static bool is_mapped(const void *bp)
+{
+    return mem_arena_of(bp) < 0;
+}
+
+static void *map_malloc(size_t size)
+{
+    size_t rsize = align(size + DW_SIZE);
+    char *region = mem_map(rsize);
+    if (region == (void *)-1)
+        return NULL;
+    PUT(region + W_SIZE, PACK(rsize, 1));
+    return region + DW_SIZE;
+}
+
+static void map_free(char *bp)
+{
+    mem_unmap(bp - DW_SIZE, GET_SIZE(HDRP(bp)));
+}
+
+static void *map_realloc(char *oldptr, size_t size)
+{
+    size_t payload = GET_SIZE(HDRP(oldptr)) - DW_SIZE;
+    if (size >= MAP_THRESHOLD && size <= payload)    // still large and still fits
+        return oldptr;
+
+    char *new_ptr = malloc(size);
+    if (new_ptr != NULL)
+    {
+        memcpy(new_ptr, oldptr, size < payload ? size : payload);
+        map_free(oldptr);
+    }
+    return new_ptr;
+}
+
+/*
+ * arena_init - create the empty heap of the current arena
+ */
+static bool arena_init(void)
+{
+ /* Create the initial empty heap */
+    if ((arena->heap_listp = mem_arena_sbrk(arena->index, 4*W_SIZE)) == (void *)-1)	
+    {
+        arena->heap_listp = NULL;
+        return false;
+    }
+    PUT(arena->heap_listp, 0); /* Alignment padding */
+    PUT(arena->heap_listp + (1*W_SIZE), PACK(DW_SIZE, 1)); /* Prologue header */
+    PUT(arena->heap_listp + (2*W_SIZE), PACK(DW_SIZE, 1)); /* Prologue footer */
+	    PUT(arena->heap_listp + (3*W_SIZE), PACK(0, 0x4 | 0x2 | 1)); /* Epilogue header, prologue is 16 bytes */
+	    arena->heap_listp += (2*W_SIZE);
+
+    memset(arena->freeLists, 0, sizeof(arena->freeLists));         // every size class starts out empty
+    arena->miniList = NULL;
+    arena->trimThreshold = TRIM_THRESHOLD;
+    arena->trimmed = false;
+    arena->frees = 0;
+#ifndef TLSF
+    arena->scavengeSize = SCAVENGE_MIN;
+    arena->scavengeAddr = NULL;
+#endif
+    arena->extends = 0;
+    arena->extendBytes = 0;
+    memset(arena->runs, 0, sizeof(arena->runs));
+    memset(arena->runMap, 0, (arena->runMapEnd + 63) / 64 * sizeof(uint64_t));
+    arena->runMapEnd = 0;
+    memset(arena->quick, 0, sizeof(arena->quick));
+    memset(arena->quickCount, 0, sizeof(arena->quickCount));
+    arena->quickMap = 0;
+#ifdef TLSF
+    arena->flBitmap = 0;
+    memset(arena->slBitmap, 0, sizeof(arena->slBitmap));
+#else
+    arena->classMap = 0;
+#endif
+	 /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+	    if (extend_heap(CHUNKSIZE/W_SIZE) == NULL)
+        return false;
+    return true;
+}
+
+/*
+ * Initialize: returns false on error, true on success.
+ * In thread-safe builds no other thread may be inside the allocator.
+ * Only arena 0 is created here; the others are created on first use.
+ */
+
+bool mm_init(void)
+{
+    if (mem_arena_count() < NUM_ARENAS)
+        return false;
+    for (int i = 0; i < NUM_ARENAS; i++)
+    {
+        arenas[i].heap_listp = NULL;
+        arenas[i].index = i;
+        arenas[i].base = mem_arena_lo(i);
+#ifdef THREAD_SAFE
+        pthread_mutex_init(&arenas[i].lock, NULL);
+        arenas[i].remote = NULL;
+        arenas[i].remotePushes = 0;
+#endif
+    }
+    arena = &arenas[0];
+    if (!arena_init())
+        return false;
+#ifdef THREAD_SAFE
+    heap_generation++;          // blocks cached by any thread belong to the old heap
+#endif
+    mm_checkheap(0);
+    return true;
+}
+
+/*
+ * mm_get_stats - sum the counters of every arena created since mm_init.
+ * The counts are read without the arena locks, so they are only exact
+ * while no other thread is inside the allocator.
+ */
+void mm_get_stats(mm_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < NUM_ARENAS; i++)
+    {
+        if (arenas[i].heap_listp == NULL)
+            continue;
+        stats->extend_calls += arenas[i].extends;
+        stats->extend_bytes += arenas[i].extendBytes;
+    }
+}
+
+
+/*
+ * heap_carve - take an allocated block of *count times aligned_size bytes
+ * from the first free block that fits aligned_size, extending the heap if
+ * none does. If the free block holds fewer, *count is lowered to match.
+ * Unless zero is NULL, *zero is set to 0x8 if that block was zeroed.
+ * In thread-safe builds the caller must hold the arena's lock.
+ */
+static char *heap_carve(size_t aligned_size, size_t *count, size_t *zero)
+{
+    size_t extend_size;
+    char *bp;
+
+    if ((bp = search_fit(aligned_size)) != NULL ||		// check if there is a fit,
+        (quick_flush() && (bp = search_fit(aligned_size)) != NULL))  {	// also once the quick lists are released
+        dbg_printf("bp size: %lu\n", GET_SIZE(HDRP(bp)));
+        if (GET_SIZE(HDRP(bp)) / aligned_size < *count)
+            *count = GET_SIZE(HDRP(bp)) / aligned_size;
+        aligned_size *= *count;
+        if (zero)
+            *zero = GET_ZEROED(HDRP(bp));
+        place(bp, aligned_size);
+        mm_checkheap(0);
+        dbg_printf("alloc done for bp: %p\n", bp);
+        return bp;
+    }
+
+    aligned_size *= *count;
+    extend_size = tail_free();					// otherwise heap must be extended,
+    extend_size = grow_size(extend_size < aligned_size ?		// by no more than the top block lacks
+                            aligned_size - extend_size : aligned_size);
+    dbg_printf("aligned_size: %lu extend_size: %lu\n", aligned_size, extend_size);
+    if ((bp = extend_heap(extend_size/W_SIZE)) == NULL) {				// extend heap
         return NULL;									               // if fail return NULL
     }
 
-    mm_checkheap(0);
-    dbg_printf("bp size: %lu\n", GET_SIZE(HDRP(bp)));
-    place(bp, aligned_size);								// otherwise place in free block
-    mm_checkheap(0);
-    dbg_printf("alloc done for bp: %p\n", bp);
+    mm_checkheap(0);
+    dbg_printf("bp size: %lu\n", GET_SIZE(HDRP(bp)));
+    if (zero)
+        *zero = GET_ZEROED(HDRP(bp));
+    place(bp, aligned_size);								// otherwise place in free block
+    mm_checkheap(0);
+    dbg_printf("alloc done for bp: %p\n", bp);
+    return bp;
+}
+
+/*
+ * heap_malloc - allocate from the current arena. In thread-safe builds
+ * the caller must hold its lock.
+ */
+static void *heap_malloc(size_t size)
+{
+    size_t aligned_size = size; 
+    char *bp;
+
+    /* IMPLEMENT THIS */
+    if (size == 0) {    // returns NULL if size is 0
+        return NULL;
+    }
+
+    if (size >= MAP_THRESHOLD) {    // large requests are mapped on their own
+        return map_malloc(size);
+    }
+    if (size <= SLAB_MAX && (bp = slab_malloc(size)) != NULL) {     // small requests come from slab runs
+        return bp;
+    }
+
+    aligned_size = adjust_size(size);
+
+    dbg_printf("aligned size: %lu\n", aligned_size);
+
+    if ((bp = quick_pop(aligned_size)) != NULL) {      // a recently freed block of the same size
+        mm_checkheap(0);
+        return bp;
+    }
+    size_t count = 1;
+    return heap_carve(aligned_size, &count, NULL);
+}
+
+/*
+ * heap_calloc - heap_malloc for a block of size bytes that reads as zero.
+ * Mapped regions are zero-filled already. A block carved from a zeroed
+ * free block only needs the words the free block kept there cleared:
+ * its links, and its footer when the block was not split.
+ */
+static void *heap_calloc(size_t size)
+{
+    size_t aligned_size, zero = 0, count = 1;
+    char *bp;
+
+    if (size == 0)
+        return NULL;
+    if (size >= MAP_THRESHOLD)
+        return map_malloc(size);
+    if (size <= SLAB_MAX && (bp = slab_malloc(size)) != NULL)
+    {
+        memset(bp, 0, size);
+        return bp;
+    }
+
+    aligned_size = adjust_size(size);
+    if ((bp = quick_pop(aligned_size)) == NULL &&
+        (bp = heap_carve(aligned_size, &count, &zero)) == NULL)
+        return NULL;
+    if (!zero)
+    {
+        memset(bp, 0, size);
+        return bp;
+    }
+    memset(bp, 0, size < DW_SIZE ? size : DW_SIZE);     // the links
+    if (aligned_size > DW_SIZE)
+        memset(bp + aligned_size - DW_SIZE, 0, W_SIZE); // the footer, if the block was not split
+    return bp;
+}
+
+/*
+ * heap_malloc_batch - allocate n blocks of size bytes from the current
+ * arena into out, returning how many were allocated. Heap-sized blocks
+ * come from the quick list first, then each pass carves as many as the
+ * first fit holds: one search and split for the group, then one header
+ * write per block. Slab and mapped sizes fall back to one request each.
+ */
+static size_t heap_malloc_batch(size_t size, size_t n, void **out)
+{
+    size_t aligned_size = adjust_size(size);
+    size_t group = (MAP_THRESHOLD - 1) / aligned_size;     // blocks per pass, the group stays below a region
+    size_t done = 0;
+
+    if (size == 0)
+        return 0;
+    while (done < n)
+    {
+        size_t k = n - done < group ? n - done : group;
+        if (size <= SLAB_MAX || k < 2)
+        {
+            if ((out[done] = heap_malloc(size)) == NULL)
+                break;
+            done++;
+            continue;
+        }
+        if ((out[done] = quick_pop(aligned_size)) != NULL)
+        {
+            done++;
+            continue;
+        }
+
+        char *bp = heap_carve(aligned_size, &k, NULL);
+        if (bp == NULL)
+            break;
+        size_t prevBits = GET_PREV_BITS(HDRP(bp));
+        size_t bits = 0x2 | (aligned_size == DW_SIZE ? 0x4 : 0);   // every later block follows an allocated one
+        for (size_t i = 0; i < k; i++, bp += aligned_size)
+        {
+            PUT(HDRP(bp), PACK(aligned_size, (i == 0 ? prevBits : bits) | 1));
+            out[done + i] = bp;
+        }
+        SET_PREV_MINI(HDRP(bp), aligned_size == DW_SIZE);
+        done += k;
+        mm_checkheap(0);
+    }
+    return done;
+}
+
+/*
+ * heap_memalign - allocate size bytes aligned to alignment, a power of two
+ * above ALIGNMENT, from the current arena. Aligned blocks always come from
+ * the heap, never from slab runs or mapped regions, so they free, resize
+ * and report their size like any other heap block.
+ */
+static void *heap_memalign(size_t alignment, size_t size)
+{
+    size_t aligned_size = adjust_size(size);
+    char *bp;
+
+    if (size == 0 || size > SIZE_MAX / 4 || alignment > SIZE_MAX / 4)
+        return NULL;                                        // the padded size would overflow
+
+    if ((bp = search_aligned(alignment, aligned_size)) == NULL &&
+        (!quick_flush() || (bp = search_aligned(alignment, aligned_size)) == NULL))
+    {
+        size_t need = aligned_size + alignment - DW_SIZE;   // enough whatever the padding
+        size_t extend_size = tail_free();
+        extend_size = grow_size(extend_size < need ? need - extend_size : need);
+        if ((bp = extend_heap(extend_size / W_SIZE)) == NULL)
+            return NULL;
+    }
+    bp = place_aligned(bp, align_pad(bp, alignment), aligned_size);
+    mm_checkheap(0);
+    return bp;
+}
+
+/*
+ * heap_release - free the heap block ptr of csize bytes
+ */
+static void heap_release(char *ptr, size_t csize)
+{
+    dbg_printf("free called for %p of size: %lu\n", ptr, csize);
+    if (!quick_push(ptr, csize))                    // coalescing waits for small blocks
+        block_free(ptr);
+    if (++arena->frees % SCAVENGE_PERIOD == 0)      // now and then release idle pages
+        scavenge();
+    mm_checkheap(0);
+}
+
+/*
+ * heap_free - return a block to the current arena, which must own it
+ */
+static void heap_free(void* ptr)
+{
+    /* IMPLEMENT THIS */
+    if (ptr == NULL)
+    {
+        return;
+    }
+    if (is_mapped(ptr))
+    {
+        map_free(ptr);
+        return;
+    }
+    if (is_slab(ptr))
+    {
+        slab_free(ptr);
+        return;
+    }
+
+    heap_release(ptr, GET_SIZE(HDRP(ptr)));
+    // return ptr;
+
+}
+
+/*
+ * heap_free_sized - heap_free for a caller that knows the size it asked
+ * for. Mapped and slab blocks are told apart by address, and a heap
+ * block's size is adjust_size of its request, so no header is read
+ * before the block reaches its quick list.
+ */
+static void heap_free_sized(void *ptr, size_t size)
+{
+    if (ptr == NULL || is_mapped(ptr) || (size <= SLAB_MAX && is_slab(ptr)))
+    {
+        heap_free(ptr);
+        return;
+    }
+    dbg_assert(GET_SIZE(HDRP(ptr)) == adjust_size(size));
+    heap_release(ptr, adjust_size(size));
+}
+
+/*
+ * heap_free_batch - free n blocks of the current arena, sorted by address.
+ * Neighbouring heap blocks are joined into one block first, which is then
+ * freed and coalesced once. A block without a freed neighbour takes the
+ * ordinary path.
+ */
+static void heap_free_batch(void **ptrs, size_t n)
+{
+    unsigned frees = arena->frees;
+
+    for (size_t i = 0; i < n; )
+    {
+        size_t first = i;
+        char *bp = ptrs[i++];
+        if (bp == NULL || is_mapped(bp) || is_slab(bp))
+        {
+            heap_free(bp);
+            continue;
+        }
+        size_t size = GET_SIZE(HDRP(bp));
+        while (i < n && (char *)ptrs[i] == bp + size && !is_slab(ptrs[i]))     // the next block is freed too
+            size += GET_SIZE(HDRP((char *)ptrs[i++]));
+        if (size == GET_SIZE(HDRP(bp)))
+        {
+            if (!quick_push(bp, size))
+                block_free(bp);
+        }
+        else
+        {
+            PUT(HDRP(bp), PACK(size, GET_PREV_BITS(HDRP(bp)) | 1));
+            SET_PREV_MINI(HDRP(NEXT_BLKP(bp)), false);
+            block_free(bp);
+        }
+        arena->frees += i - first;
+    }
+    if (arena->frees / SCAVENGE_PERIOD != frees / SCAVENGE_PERIOD)    // paced like single frees
+        scavenge();
+    mm_checkheap(0);
+}
+
+/*
+ * heap_realloc - resize a block owned by the current arena
+ */
+static void *heap_realloc(void* oldptr, size_t size)
+{
+    /* IMPLEMENT THIS */
+    dbg_printf("realloc called\n");
+    if (oldptr == NULL) {
+        return heap_malloc(size);
+    }
+
+    if (size == 0) {
+        heap_free(oldptr);
+        return NULL;
+    }
+
+    if (is_mapped(oldptr)) {
+        return map_realloc(oldptr, size);
+    }
+    if (is_slab(oldptr)) {              // slab slots only move, unless they still fit
+        size_t slot = GET_FIELD(&run_of(oldptr)->size);
+        if (size <= slot) {
+            return oldptr;
+        }
+        char *new_ptr = heap_malloc(size);
+        if (new_ptr != NULL) {
+            memcpy(new_ptr, oldptr, slot);
+            slab_free(oldptr);
+        }
+        return new_ptr;
+    }
+
+    size_t aligned_size = adjust_size(size);
+    size_t csize = GET_SIZE(HDRP(oldptr));
+    char *next = NEXT_BLKP(oldptr);
+
+    if (aligned_size <= csize) {        // Case 1: shrinking, split in place and free the tail
+        split_block(oldptr, csize, aligned_size, 0);
+        mm_checkheap(0);
+        return oldptr;
+    }
+
+    size_t avail = csize;               // bytes available without moving the block
+    if (!GET_ALLOC(HDRP(next))) {
+        avail += GET_SIZE(HDRP(next));
+    }
+
+    if (aligned_size <= avail) {        // Case 2: grow into the free successor
+        free_delete(next);
+        split_block(oldptr, avail, aligned_size, 0);
+        mm_checkheap(0);
+        return oldptr;
+    }
+
+    if (!GET_PREV_ALLOC(HDRP(oldptr)) &&                                // Case 3: slide down into the free
+        aligned_size <= avail + GET_SIZE(HDRP(PREV_BLKP(oldptr)))) {   // predecessor (and successor)
+        char *prev = PREV_BLKP(oldptr);
+        free_delete(prev);
+        if (avail != csize) {
+            free_delete(next);
+        }
+        avail += GET_SIZE(HDRP(prev));
+        memmove(prev, oldptr, csize - W_SIZE);      // regions overlap when the predecessor is small
+        split_block(prev, avail, aligned_size, 0);
+        mm_checkheap(0);
+        return prev;
+    }
+
+    if (size < MAP_THRESHOLD &&                                         // Case 4: at the heap tail,
+        GET_SIZE(HDRP(avail == csize ? next : NEXT_BLKP(next))) == 0) {   // unless it should be mapped,
+        if (extend_heap((aligned_size - avail) / W_SIZE) == NULL) {     // grow by the deficit only
+            return NULL;
+        }
+        next = NEXT_BLKP(oldptr);       // the new space, coalesced with any free successor
+        avail = csize + GET_SIZE(HDRP(next));
+        free_delete(next);
+        split_block(oldptr, avail, aligned_size, 0);
+        mm_checkheap(0);
+        return oldptr;
+    }
+
+    char* new_ptr = heap_malloc(size);  // Case 5: malloc the new size,
+
+    if (new_ptr == NULL) {          // if new_ptr equal null, then malloc failed, return null
+        return NULL;
+    }
+
+    size_t old_size = GET_SIZE(HDRP(oldptr)) - W_SIZE;  // set old size to payload size of old ptr
+    if (old_size > size) {     // Case 2: if old size is less than new size, 
+        old_size = size;
+    }
+
+    memcpy(new_ptr, oldptr, old_size);     // copy data from oldptr to new ptr
+    heap_free(oldptr);                     // free data from the oldptr
+
+    return new_ptr;                 // return ptr to newly allocated memory        
+}
+
+#ifdef THREAD_SAFE
+/*
+ * Arena selection. A thread is given a home arena round-robin on its
+ * first allocation. When its home is busy it tries the other arenas and
+ * moves to the first idle one, so contended threads spread out. Frees
+ * and reallocs always lock the arena that owns the block.
+ */
+static unsigned next_home;              // round-robin counter for home arenas
+
+static void remote_drain(void);
+
+static void arena_lock(arena_t *a)      // lock a, make it the current arena and take its remote frees
+{
+    pthread_mutex_lock(&a->lock);
+    arena = a;
+    remote_drain();
+}
+
+static void arena_unlock(void)
+{
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+ * Remote frees. A thread freeing a block owned by an arena other than its
+ * home pushes it onto that arena's remote stack with a CAS instead of
+ * taking the arena's lock. Many threads push, but only the lock holder
+ * pops, and it takes the whole stack with one exchange, so the stack
+ * never sees ABA. Whoever next locks the arena drains it, whether its
+ * owner allocating or any thread freeing there. An arena no thread locks
+ * would keep its stack forever, so after REMOTE_MAX pushes the pusher
+ * drains the stack itself if the lock is free.
+ */
+#define REMOTE_MAX 64
+
+static void remote_push(arena_t *a, char *first, char *last)   // push the chain first..last
+{
+    char *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+    do
+        PUT_PTR(MINI_NEXT(last), head);
+    while (!__atomic_compare_exchange_n(&a->remote, &head, first, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    if (__atomic_add_fetch(&a->remotePushes, 1, __ATOMIC_RELAXED) < REMOTE_MAX)
+        return;
+    if (pthread_mutex_trylock(&a->lock) != 0)   // a holder drains before it unlocks or soon after
+        return;
+    arena_t *prev = arena;              // the caller may hold another arena
+    arena = a;
+    remote_drain();
+    pthread_mutex_unlock(&a->lock);
+    arena = prev;
+}
+
+static void remote_drain(void)          // free every block queued on the current arena (lock held)
+{
+    if (__atomic_load_n(&arena->remote, __ATOMIC_RELAXED) == NULL)
+        return;
+    __atomic_store_n(&arena->remotePushes, 0, __ATOMIC_RELAXED);
+    char *bp = __atomic_exchange_n(&arena->remote, NULL, __ATOMIC_ACQUIRE);
+    while (bp)
+    {
+        char *next = GET_PTR(MINI_NEXT(bp));
+        heap_free(bp);
+        bp = next;
+    }
+}
+
+static bool lock_home(void)             // lock this thread's home arena, creating it on first use
+{
+    if (home == NULL)
+        home = &arenas[__atomic_fetch_add(&next_home, 1, __ATOMIC_RELAXED) % NUM_ARENAS];
+
+    if (pthread_mutex_trylock(&home->lock) != 0)
+    {
+        int i;
+        for (i = 1; i < NUM_ARENAS; i++)        // contended: move to the first idle arena
+        {
+            arena_t *a = &arenas[(home->index + i) % NUM_ARENAS];
+            if (pthread_mutex_trylock(&a->lock) == 0)
+            {
+                home = a;
+                break;
+            }
+        }
+        if (i == NUM_ARENAS)
+            pthread_mutex_lock(&home->lock);
+    }
+    arena = home;
+    if (arena->heap_listp == NULL && !arena_init())
+    {
+        arena_unlock();
+        return false;
+    }
+    remote_drain();
+    return true;
+}
+
+/*
+ * Thread caches. Each thread keeps a cache of recently freed blocks of
+ * the small sizes (16 .. TCACHE_MAX bytes, one bin per 16 bytes); a
+ * cache hit takes no lock. Cached blocks stay marked allocated in their
+ * arena. A miss refills TCACHE_BATCH blocks of the size from the home
+ * arena under one lock acquisition, and a bin holding more than
+ * TCACHE_FILL blocks flushes TCACHE_BATCH of them back to their owners.
+ */
+#define TCACHE_MAX 512
+#define TCACHE_BINS (TCACHE_MAX / 16)
+#define TCACHE_BATCH 16
+#define TCACHE_FILL 64
+
+typedef struct {
+    char *bins[TCACHE_BINS];            // singly-linked through the first payload word
+    unsigned count[TCACHE_BINS];
+    unsigned long generation;           // heap_generation the cached blocks belong to
+} tcache_t;
+
+static __thread tcache_t tcache;
+static pthread_key_t tcache_key;        // runs tcache_exit when a thread ends
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+static void tcache_flush(tcache_t *tc, int bin, unsigned n)
+{
+    arena_t *locked = NULL;             // keep the lock while blocks share an owner
+    while (n > 0 && tc->bins[bin])
+    {
+        char *bp = tc->bins[bin];
+        arena_t *owner = arena_of(bp);
+        if (mm_remote_free && owner != home)    // someone else's: queue the run of blocks it owns
+        {
+            char *last = bp;
+            for (n--; n > 0 && GET_PTR(MINI_NEXT(last)) && arena_of(GET_PTR(MINI_NEXT(last))) == owner; n--)
+            {
+                last = GET_PTR(MINI_NEXT(last));
+                tc->count[bin]--;
+            }
+            tc->bins[bin] = GET_PTR(MINI_NEXT(last));
+            tc->count[bin]--;
+            remote_push(owner, bp, last);
+            continue;
+        }
+        tc->bins[bin] = GET_PTR(MINI_NEXT(bp));
+        tc->count[bin]--;
+        n--;
+        if (owner != locked)
+        {
+            if (locked)
+                arena_unlock();
+            locked = owner;
+            arena_lock(locked);
+        }
+        heap_free(bp);
+    }
+    if (locked)
+        arena_unlock();
+}
+
+static void tcache_exit(void *arg)      // hand every cached block back when its thread exits
+{
+    tcache_t *tc = arg;
+    if (tc->generation != heap_generation)
+        return;
+    for (int bin = 0; bin < TCACHE_BINS; bin++)
+        tcache_flush(tc, bin, tc->count[bin]);
+}
+
+static void tcache_key_init(void)
+{
+    pthread_key_create(&tcache_key, tcache_exit);
+}
+
+static tcache_t *tcache_get(void)       // this thread's cache, emptied if the heap was reinitialized
+{
+    tcache_t *tc = &tcache;
+    if (tc->generation != heap_generation)
+    {
+        memset(tc->bins, 0, sizeof(tc->bins));
+        memset(tc->count, 0, sizeof(tc->count));
+        tc->generation = heap_generation;
+        pthread_once(&tcache_once, tcache_key_init);
+        pthread_setspecific(tcache_key, tc);
+    }
+    return tc;
+}
+
+static void *tcache_malloc(size_t aligned_size)
+{
+    tcache_t *tc = tcache_get();
+    int bin = (int)(aligned_size / DW_SIZE) - 1;
+    char *bp = tc->bins[bin];
+
+    if (bp == NULL)                     // miss: refill a batch from the home arena
+    {
+        if (!lock_home())
+            return NULL;
+        for (int i = 0; i < TCACHE_BATCH; i++)
+        {
+            char *p = heap_malloc(aligned_size - W_SIZE);       // payload that rounds to exactly aligned_size
+            if (p == NULL)
+                break;
+            PUT_PTR(MINI_NEXT(p), tc->bins[bin]);
+            tc->bins[bin] = p;
+            tc->count[bin]++;
+        }
+        arena_unlock();
+        if ((bp = tc->bins[bin]) == NULL)
+            return NULL;
+    }
+    tc->bins[bin] = GET_PTR(MINI_NEXT(bp));
+    tc->count[bin]--;
+    return bp;
+}
+
+static void tcache_free(char *bp, size_t csize)
+{
+    tcache_t *tc = tcache_get();
+    int bin = (int)(csize / DW_SIZE) - 1;
+
+    PUT_PTR(MINI_NEXT(bp), tc->bins[bin]);
+    tc->bins[bin] = bp;
+    if (++tc->count[bin] > TCACHE_FILL) // overflow: flush a batch to the owning arenas
+        tcache_flush(tc, bin, TCACHE_BATCH);
+}
+#endif /* THREAD_SAFE */
+
+/*
+ * malloc
+ */
+void* malloc(size_t size)
+{
+#ifdef THREAD_SAFE
+    if (size == 0)
+        return NULL;
+    size_t aligned_size = adjust_size(size);
+    if (aligned_size <= TCACHE_MAX)
+        return tcache_malloc(aligned_size);
+    if (size >= MAP_THRESHOLD)
+        return map_malloc(size);
+
+    if (!lock_home())
+        return NULL;
+    void *bp = heap_malloc(size);
+    arena_unlock();
     return bp;
+#else
+    return heap_malloc(size);
+#endif
 }
 
 /*
@@ -367,23 +2142,83 @@ void* malloc(size_t size)
  */
 void free(void* ptr)
 {
-    /* IMPLEMENT THIS */
+#ifdef THREAD_SAFE
     if (ptr == NULL)
+        return;
+    if (is_mapped(ptr))
+    {
+        map_free(ptr);
+        return;
+    }
+    size_t csize = is_slab(ptr) ? GET_FIELD(&run_of(ptr)->size) : GET_SIZE(HDRP(ptr));
+    if (csize <= TCACHE_MAX)
     {
+        tcache_free(ptr, csize);
         return;
     }
 
-    size_t size = GET_SIZE(HDRP(ptr));
-    dbg_printf("free called for %p of size: %lu\n", (char *)ptr, size);
-    dbg_printf("size: %lu\n", size);
-    PUT(HDRP(ptr), PACK(size, 0));
-    PUT(FTRP(ptr), PACK(size, 0));
-    *NEXT_PTR(ptr) = NULL;
-    *PREV_PTR(ptr) = NULL;
-    coalesce(ptr);
-    mm_checkheap(0);
-    // return ptr;
+    arena_t *owner = arena_of(ptr);
+    if (mm_remote_free && owner != home)
+    {
+        remote_push(owner, ptr, ptr);
+        return;
+    }
+    arena_lock(owner);
+    heap_free(ptr);
+    arena_unlock();
+#else
+    heap_free(ptr);
+#endif
+}
+
+/*
+ * mm_free_sized - free ptr, whose size the caller knows: the size last
+ * requested for it, or anything up to mm_usable_size(ptr)
+ */
+void mm_free_sized(void *ptr, size_t size)
+{
+#ifdef THREAD_SAFE
+    if (ptr == NULL || is_mapped(ptr))
+    {
+        free(ptr);
+        return;
+    }
+    size_t csize = size <= SLAB_MAX && is_slab(ptr) ?
+        GET_FIELD(&run_of(ptr)->size) : // the slot size of its run, as free() bins it
+        adjust_size(size);
+    if (csize <= TCACHE_MAX)
+    {
+        tcache_free(ptr, csize);
+        return;
+    }
+
+    arena_t *owner = arena_of(ptr);
+    if (mm_remote_free && owner != home)
+    {
+        remote_push(owner, ptr, ptr);
+        return;
+    }
+    arena_lock(owner);
+    heap_free_sized(ptr, size);
+    arena_unlock();
+#else
+    heap_free_sized(ptr, size);
+#endif
+}
 
+/*
+ * mm_usable_size - bytes of the block at ptr the caller may use, at least
+ * the size it asked for; 0 for NULL
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    if (is_mapped(ptr))
+        return GET_SIZE(HDRP(ptr)) - DW_SIZE;      // the region, less its header words
+    if (is_slab(ptr))
+        return GET_FIELD(&run_of(ptr)->size);
+    return GET_SIZE(HDRP(ptr)) - W_SIZE;            // allocated blocks have no footer
 }
 
 /*
@@ -391,47 +2226,175 @@ void free(void* ptr)
  */
 void* realloc(void* oldptr, size_t size)
 {
-    /* IMPLEMENT THIS */
-    dbg_printf("realloc called\n");
-    if (oldptr == NULL) {
+#ifdef THREAD_SAFE
+    if (oldptr == NULL)
         return malloc(size);
-    }
-
-    if (size == 0) {
+    if (size == 0)
+    {
         free(oldptr);
         return NULL;
     }
+    if (is_mapped(oldptr))
+        return map_realloc(oldptr, size);
 
-    char* new_ptr = malloc(size);       // malloc the new size,
+    arena_lock(arena_of(oldptr));
+    void *bp = heap_realloc(oldptr, size);
+    arena_unlock();
+    return bp;
+#else
+    return heap_realloc(oldptr, size);
+#endif
+}
 
-    if (new_ptr == NULL) {          // if new_ptr equal null, then malloc failed, return null
+/*
+ * calloc - memory from mem_sbrk or mem_map that was never used, or that
+ * was handed back since, already reads as zero and is not cleared again
+ */
+void* calloc(size_t nmemb, size_t size)
+{
+    if (nmemb != 0 && size > SIZE_MAX / nmemb)
         return NULL;
+    size *= nmemb;
+#ifdef THREAD_SAFE
+    if (size != 0 && adjust_size(size) <= TCACHE_MAX)
+    {
+        void *ptr = malloc(size);
+        if (ptr)
+            memset(ptr, 0, size);
+        return ptr;
     }
+    if (size >= MAP_THRESHOLD)
+        return map_malloc(size);
 
-    size_t old_size = GET_SIZE(HDRP(oldptr));           // set old size to size of old ptr     
-    if (old_size > size) {     // Case 2: if old size is less than new size, 
-        old_size = size;
+    if (!lock_home())
+        return NULL;
+    void *bp = heap_calloc(size);
+    arena_unlock();
+    return bp;
+#else
+    return heap_calloc(size);
+#endif
+}
+
+/*
+ * memalign - allocate size bytes whose address is a multiple of alignment,
+ * a power of two; NULL if it is not one. Alignments up to ALIGNMENT are
+ * what malloc gives anyway.
+ */
+void *memalign(size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        return NULL;
+    if (alignment <= ALIGNMENT)
+        return malloc(size);
+#ifdef THREAD_SAFE
+    if (!lock_home())
+        return NULL;
+    void *bp = heap_memalign(alignment, size);
+    arena_unlock();
+    return bp;
+#else
+    return heap_memalign(alignment, size);
+#endif
+}
+
+/*
+ * posix_memalign - memalign that reports errors by their code: EINVAL
+ * unless alignment is a power of two multiple of sizeof(void *), ENOMEM
+ * when memory ran out
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    void *bp = memalign(alignment, size);
+    if (bp == NULL && size != 0)
+        return ENOMEM;
+    *memptr = bp;
+    return 0;
+}
+
+/*
+ * aligned_alloc
+ */
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+/*
+ * mm_malloc_batch - allocate n blocks of size bytes into out; returns the
+ * number allocated, fewer than n only if memory ran out.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+#ifdef THREAD_SAFE
+    size_t done = 0;
+    if (size == 0)
+        return 0;
+    if (adjust_size(size) <= TCACHE_MAX || size >= MAP_THRESHOLD)   // already cheap one by one
+    {
+        while (done < n && (out[done] = malloc(size)) != NULL)
+            done++;
+        return done;
     }
+    if (!lock_home())
+        return 0;
+    done = heap_malloc_batch(size, n, out);
+    arena_unlock();
+    return done;
+#else
+    return heap_malloc_batch(size, n, out);
+#endif
+}
 
-    memcpy(new_ptr, oldptr, old_size);     // copy data from oldptr to new ptr
-    free(oldptr);                          // free data from the oldptr
+#define SORT_MIN 32                             // larger batches are sorted with qsort
 
-    return new_ptr;                 // return ptr to newly allocated memory        
+static int ptr_cmp(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t)*(void * const *)a;
+    uintptr_t y = (uintptr_t)*(void * const *)b;
+    return (x > y) - (x < y);
 }
 
 /*
- * calloc
- * This function is not tested by mdriver, and has been implemented for you.
+ * mm_free_batch - free the n blocks in ptrs. The array is sorted by
+ * address in place, so that neighbouring blocks coalesce in one sweep.
  */
-void* calloc(size_t nmemb, size_t size)
+void mm_free_batch(void **ptrs, size_t n)
 {
-    void* ptr;
-    size *= nmemb;
-    ptr = malloc(size);
-    if (ptr) {
-        memset(ptr, 0, size);
+    if (n > SORT_MIN)
+        qsort(ptrs, n, sizeof(*ptrs), ptr_cmp);
+    else
+    {
+        for (size_t i = 1; i < n; i++)                  // insertion sort for the usual small batch
+        {
+            void *p = ptrs[i];
+            size_t j = i;
+            for (; j > 0 && (uintptr_t)ptrs[j - 1] > (uintptr_t)p; j--)
+                ptrs[j] = ptrs[j - 1];
+            ptrs[j] = p;
+        }
+    }
+#ifdef THREAD_SAFE
+    for (size_t i = 0, j; i < n; i = j)         // each arena's blocks are contiguous once sorted
+    {
+        j = i + 1;
+        if (ptrs[i] == NULL || is_mapped(ptrs[i]))
+        {
+            free(ptrs[i]);
+            continue;
+        }
+        arena_t *owner = arena_of(ptrs[i]);
+        while (j < n && !is_mapped(ptrs[j]) && arena_of(ptrs[j]) == owner)
+            j++;
+        arena_lock(owner);
+        heap_free_batch(ptrs + i, j - i);
+        arena_unlock();
     }
-    return ptr;
+#else
+    heap_free_batch(ptrs, n);
+#endif
 }
 
 /*
@@ -456,13 +2419,46 @@ static bool aligned(const void* p)
 /*
  * mm_checkheap
  */
-bool mm_checkheap(int lineno)
-{
 #ifdef DEBUG
+/*
+ * check_arena - walk the heap and free lists of the current arena
+ */
+static bool check_arena(void)
+{
     char* bp;
+    bool prev_alloc = true;                                                     // the prologue is allocated
+    bool prev_mini = true;                                                      // and 16 bytes long
     
-    for (bp = heap_listp; GET_SIZE(HDRP(bp)) != 0; bp = NEXT_BLKP(bp))          // loops through the heap while the header is not equal to zero
+    for (bp = arena->heap_listp; GET_SIZE(HDRP(bp)) != 0; bp = NEXT_BLKP(bp))          // loops through the heap while the header is not equal to zero
     {
+        if (bp != arena->heap_listp && (GET_PREV_ALLOC(HDRP(bp)) != 0) != prev_alloc)  // prev-alloc bit must match the previous block
+        {
+            printf("Block %p has a stale prev-alloc bit\n", bp);
+            return false;
+        }
+        if (bp != arena->heap_listp && (GET_PREV_MINI(HDRP(bp)) != 0) != prev_mini)    // and so must the prev-mini bit
+        {
+            printf("Block %p has a stale prev-mini bit\n", bp);
+            return false;
+        }
+        prev_alloc = GET_ALLOC(HDRP(bp));
+        prev_mini = GET_SIZE(HDRP(bp)) == DW_SIZE;
+        if (!GET_ALLOC(HDRP(bp)) && GET_ZEROED(HDRP(bp)))                       // a zeroed block must read as zero
+        {
+            if (prev_mini)
+            {
+                printf("Mini block %p is marked zeroed\n", bp);
+                return false;
+            }
+            for (char *p = bp + DW_SIZE; p < FTRP(bp); p += W_SIZE)
+            {
+                if (GET(p) != 0)
+                {
+                    printf("Zeroed block %p holds data at %p\n", bp, p);
+                    return false;
+                }
+            }
+        }
         if (GET_ALLOC(HDRP(bp)))                                                // checks if the block is allocated   
         {
             printf("Allocated Block: %p of size: %lu/n", bp, GET_SIZE(HDRP(bp)));       // prints the address of the block and the size of the block
@@ -474,10 +2470,111 @@ bool mm_checkheap(int lineno)
     }
 
     printf("-------\n");
-    for (bp = freePtr; bp; bp = *NEXT_PTR(bp))                              // loops through the free list 
+    char *miniPrev = NULL;
+    for (bp = arena->miniList; bp; miniPrev = bp, bp = mini_next(bp))                  // loops through the mini list
+    {
+        if (GET_SIZE(HDRP(bp)) != DW_SIZE || GET_ALLOC(HDRP(bp)))
+        {
+            printf("Block %p on the mini list is not a free mini block\n", bp);
+            return false;
+        }
+        if (mini_ptr(GET(bp) >> 32) != miniPrev)
+        {
+            printf("Block %p on the mini list has a stale back link\n", bp);
+            return false;
+        }
+    }
+    for (int cls = 0; cls < NUM_CLASSES; cls++)                             // loops through every size class
     {
-        printf("Free block (explicit list): %p of size: %lu\n", bp, GET_SIZE(HDRP(bp)));        // prints the address of the free block and the size
+        for (bp = free_first(cls, 0); bp; bp = free_next(cls, bp))              // loops through the free list of the class
+        {
+            printf("Free block (class %d): %p of size: %lu\n", cls, bp, GET_SIZE(HDRP(bp)));        // prints the address of the free block and the size
+            if (size_class(GET_SIZE(HDRP(bp))) != cls)                      // block must sit in the bucket of its size
+            {
+                printf("Block %p is in the wrong size class\n", bp);
+                return false;
+            }
+        }
+    }
+#ifndef TLSF
+    for (int cls = 0; cls < NUM_CLASSES; cls++)                             // trees must be in key order
+    {
+        if (!is_tree(cls))
+            continue;
+        for (char *prev = NULL, *bp = free_first(cls, 0); bp; prev = bp, bp = free_next(cls, bp))
+        {
+            if (prev && tree_cmp(cls, tree_size(cls, prev), prev, bp) >= 0)
+            {
+                printf("Tree node %p of class %d is out of order\n", bp, cls);
+                return false;
+            }
+        }
+    }
+#endif
+    for (int cls = 0; cls < SLAB_CLASSES; cls++)                            // loops through the partial runs
+    {
+        for (run_t *run = arena->runs[cls]; run; run = (run_t *)GET_FIELD(&run->next))
+        {
+            size_t nfree = 0;
+            for (int w = 0; w < RUN_WORDS; w++)
+                nfree += __builtin_popcountll(GET_FIELD(&run->bitmap[w]));
+            if (GET_FIELD(&run->size) != (size_t)(cls + 1) * 16 || GET_FIELD(&run->nfree) != nfree || nfree == 0)
+            {
+                printf("Run %p of class %d is inconsistent\n", (void *)run, cls);
+                return false;
+            }
+        }
+    }
+    for (int i = 0; i < QUICK_CLASSES; i++)                                 // loops through the quick lists
+    {
+        unsigned count = 0;
+        for (bp = arena->quick[i]; bp; bp = GET_PTR((char **)bp), count++)
+        {
+            if (GET_SIZE(HDRP(bp)) != (size_t)i * DW_SIZE || !GET_ALLOC(HDRP(bp)))
+            {
+                printf("Block %p on quick list %d is not an allocated block of its size\n", bp, i);
+                return false;
+            }
+        }
+        if (count != arena->quickCount[i] || (count > 0) != ((arena->quickMap >> i) & 1))
+        {
+            printf("Quick list %d is out of sync\n", i);
+            return false;
+        }
+    }
+    for (int cls = 0; cls < NUM_CLASSES; cls++)                             // bitmaps must mirror the lists
+    {
+#ifdef TLSF
+        bool bit = (arena->slBitmap[cls / SL_COUNT] >> (cls % SL_COUNT)) & 1;
+#else
+        bool bit = (arena->classMap >> cls) & 1;
+#endif
+        if (bit != (arena->freeLists[cls] != NULL))
+        {
+            printf("Bitmap out of sync for class %d\n", cls);
+            return false;
+        }
+    }
+    return true;
+}
+#endif /* DEBUG */
+
+bool mm_checkheap(int lineno)
+{
+#ifdef DEBUG
+    arena_t *saved = arena;
+    for (int i = 0; i < NUM_ARENAS; i++)                                    // checks every arena created so far
+    {
+        if (arenas[i].heap_listp == NULL)
+            continue;
+        arena = &arenas[i];
+        if (!check_arena())
+        {
+            arena = saved;
+            return false;
+        }
     }
+    arena = saved;
     /* Write code to check heap invariants here */
     /* IMPLEMENT THIS */
 #endif /* DEBUG */
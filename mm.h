@@ -8,6 +8,9 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
 
 #else
 
@@ -16,10 +19,38 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t alignment, size_t size);
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *aligned_alloc(size_t alignment, size_t size);
 
 #endif
 
 extern bool mm_init(void);
 
+/* Allocate n blocks of size bytes into out[0..n-1] in one call; returns
+   how many were allocated */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+/* Free the n blocks in ptrs, which is sorted by address in place */
+extern void mm_free_batch(void **ptrs, size_t n);
+/* Free ptr without reading its header; size is the size last requested
+   for it, or anything up to mm_usable_size(ptr) */
+extern void mm_free_sized(void *ptr, size_t size);
+/* Bytes of the block at ptr that may be used, at least the size requested */
+extern size_t mm_usable_size(void *ptr);
+
+/* Allocator counters, summed over all arenas and reset by mm_init */
+typedef struct {
+    size_t extend_calls;    /* times the heap was extended */
+    size_t extend_bytes;    /* bytes the heap was extended by */
+} mm_stats_t;
+
+extern void mm_get_stats(mm_stats_t *stats);
+
+#ifdef THREAD_SAFE
+/* Cross-thread frees are queued lock-free for the owning arena when true,
+   and take the owner's lock when false */
+extern bool mm_remote_free;
+#endif
+
 /* This is for debugging.  Returns false if error encountered */
 extern bool mm_checkheap(int lineno);